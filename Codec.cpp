@@ -0,0 +1,525 @@
+#include "Codec.h"
+#include "CpuFeatures.h"
+#include "Kernels.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cwchar>
+#include <cwctype>
+#include <utility>
+
+template <typename Char>
+static bool endsWith(const Char* str, const char* suffix)
+{
+    size_t lenstr = 0, lensuffix = 0;
+    while (str[lenstr]) lenstr++;
+    while (suffix[lensuffix]) lensuffix++;
+    if (lensuffix > lenstr)
+        return false;
+    str += lenstr - lensuffix;
+    for (size_t i = 0; i < lensuffix; i++)
+        if (static_cast<wint_t>(str[i]) != static_cast<wint_t>(suffix[i])) return false;
+    return true;
+}
+template <typename Char>
+static bool equalsIgnoreCase(const Char* str, const char* other) {
+    for (; *str && *other; str++, other++)
+        if (towlower(static_cast<wint_t>(*str)) != towlower(static_cast<wint_t>(*other))) return false;
+    return *str == 0 && *other == 0;
+}
+template <typename Char>
+static ImageFormat imageFormatFromPath(const Char* path) {
+    if (!path) return ImageFormat::invalid;
+    if (endsWith(path, ".bin")) return ImageFormat::bin;
+    if (endsWith(path, ".txt")) return ImageFormat::txt;
+    if (endsWith(path, ".ikt")) return ImageFormat::ikt;
+    if (endsWith(path, ".iktz")) return ImageFormat::iktz;
+    if (endsWith(path, ".qoi")) return ImageFormat::qoi;
+    return ImageFormat::invalid;
+}
+template <typename Char>
+static ColorFormat colorFormatFromName(const Char* buffer) {
+    if (*buffer == 0) return ColorFormat::RGBA;
+    if (equalsIgnoreCase(buffer, "GS") || equalsIgnoreCase(buffer, "GreyScale") || equalsIgnoreCase(buffer, "Gray") || equalsIgnoreCase(buffer, "Grey")) return ColorFormat::GrayScale;
+    if (equalsIgnoreCase(buffer, "=(")) return ColorFormat::Python;
+    for (size_t i = 0; i < formatCount; i++)
+        if (equalsIgnoreCase(buffer, formatLayouts[i].name)) return static_cast<ColorFormat>(i);
+    return ColorFormat::Invalid;
+}
+ImageFormat get_imageFormat(const char* path) {
+    return imageFormatFromPath(path);
+}
+ImageFormat get_imageFormat(const wchar_t* path) {
+    return imageFormatFromPath(path);
+}
+ColorFormat parseColorFormat(const char* name) {
+    return colorFormatFromName(name);
+}
+ColorFormat parseColorFormat(const wchar_t* name) {
+    return colorFormatFromName(name);
+}
+const char* get_colorFormatName(ColorFormat cf) {
+    return cf < ColorFormat::Invalid ? get_formatLayout(cf).name : NULL;
+}
+size_t get_pixelSize(ColorFormat cf) {
+    return cf < ColorFormat::Invalid ? get_formatSize(cf) : 4;
+}
+size_t readtxtScalar(const char* text, uint8_t* data, size_t count) {
+    // 8 characters at a time as one little endian word, the first character ends up in the lowest byte
+    for (size_t i = 0; i < count; i++, text += 8) {
+        uint64_t word;
+        memcpy(&word, text, 8);
+        if ((word & 0xFEFEFEFEFEFEFEFEull) != 0x3030303030303030ull) return i;
+        // Moves bit 0 of byte k to bit 7 - k of the top byte
+        data[i] = static_cast<uint8_t>(((word - 0x3030303030303030ull) * 0x8040201008040201ull) >> 56);
+    }
+    return count;
+}
+size_t validatetxtScalar(const char* text, size_t length, size_t* first) {
+    size_t count = 0, i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, text + i, 8);
+        if ((word & 0xFEFEFEFEFEFEFEFEull) == 0x3030303030303030ull) continue;
+        for (size_t j = i; j < i + 8; j++)
+            if (text[j] != '0' && text[j] != '1' && count++ == 0) *first = j;
+    }
+    for (; i < length; i++)
+        if (text[i] != '0' && text[i] != '1' && count++ == 0) *first = i;
+    return count;
+}
+// The 8 characters of every byte value, stored as little endian words
+struct TextTable {
+    uint64_t words[256];
+};
+static constexpr TextTable makeTextTable() {
+    TextTable table{};
+    for (int byte = 0; byte < 256; byte++)
+        for (int i = 0; i < 8; ++i)
+            table.words[byte] |= static_cast<uint64_t>((byte & (1 << (7 - i))) ? '1' : '0') << (8 * i);
+    return table;
+}
+static constexpr TextTable textTable = makeTextTable();
+void writetxtScalar(const uint8_t* data, char* text, size_t count) {
+    for (size_t i = 0; i < count; i++, text += 8)
+        memcpy(text, &textTable.words[data[i]], 8);
+}
+static uint8_t hueToRgb(uint8_t p, uint8_t q, uint8_t t) {
+    if (t < 42) return p + (t * (q - p)) / 42;
+    if (t < 128) return q;
+    if (t < 170) return p + ((170 - t) * (q - p)) / 42;
+    return p;
+}
+// FloatHSL channels are little endian float64 values, whatever the compiler's long double is.
+static inline double loadFloat64(const uint8_t* data) {
+    uint64_t bits = 0;
+    for (int i = 7; i >= 0; i--)
+        bits = bits << 8 | data[i];
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+static inline void storeFloat64(uint8_t* data, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    for (int i = 0; i < 8; i++, bits >>= 8)
+        data[i] = static_cast<uint8_t>(bits);
+}
+// Clamped so broken files can't overflow the conversion, NaN ends up as 255 like in the SIMD kernels.
+static inline uint8_t pythonToByte(double x) {
+    x = x < 255.0 ? x : 255.0;
+    x = x > 0.0 ? x : 0.0;
+    return static_cast<uint8_t>(x);
+}
+static uint8_t pythonHueToRgb(double p, double q, double t) {
+    if (t < 0.0) t += 360.0;
+    if (t > 360.0) t -= 360.0;
+    if (t < 60.0) return pythonToByte((p + ((q - p) * t) / 60.0) * 255);
+    if (t < 180.0) return pythonToByte(q * 255);
+    if (t < 240.0) return pythonToByte((p + ((q - p) * (240.0 - t)) / 60.0) * 255);
+    return pythonToByte(p * 255);
+}
+// Per-pixel conversions of every color model, reading and writing the channels at the offsets the layout of cf gives them.
+template <ColorModel model>
+struct ModelCodec;
+template <>
+struct ModelCodec<ColorModel::RGB> {
+    template <ColorFormat cf>
+    static inline Pixel decode(const uint8_t* data) {
+        Pixel rgb{};
+        rgb.rgbRed = data[channelOffset(cf, 0)];
+        rgb.rgbGreen = data[channelOffset(cf, 1)];
+        rgb.rgbBlue = data[channelOffset(cf, 2)];
+        return rgb;
+    }
+    template <ColorFormat cf>
+    static inline void encode(uint8_t* data, Pixel color) {
+        data[channelOffset(cf, 0)] = color.rgbRed;
+        data[channelOffset(cf, 1)] = color.rgbGreen;
+        data[channelOffset(cf, 2)] = color.rgbBlue;
+    }
+};
+template <>
+struct ModelCodec<ColorModel::Gray> {
+    template <ColorFormat cf>
+    static inline Pixel decode(const uint8_t* data) {
+        Pixel rgb{};
+        rgb.rgbRed = data[channelOffset(cf, 0)];
+        rgb.rgbGreen = data[channelOffset(cf, 0)];
+        rgb.rgbBlue = data[channelOffset(cf, 0)];
+        return rgb;
+    }
+    template <ColorFormat cf>
+    static inline void encode(uint8_t* data, Pixel color) {
+        data[channelOffset(cf, 0)] = (color.rgbRed + color.rgbGreen + color.rgbBlue) / 3;
+    }
+};
+template <>
+struct ModelCodec<ColorModel::CMY> {
+    template <ColorFormat cf>
+    static inline Pixel decode(const uint8_t* data) {
+        Pixel rgb{};
+        rgb.rgbRed = 0xFF - data[channelOffset(cf, 0)];
+        rgb.rgbGreen = 0xFF - data[channelOffset(cf, 1)];
+        rgb.rgbBlue = 0xFF - data[channelOffset(cf, 2)];
+        return rgb;
+    }
+    template <ColorFormat cf>
+    static inline void encode(uint8_t* data, Pixel color) {
+        data[channelOffset(cf, 0)] = 0xFF - color.rgbRed;
+        data[channelOffset(cf, 1)] = 0xFF - color.rgbGreen;
+        data[channelOffset(cf, 2)] = 0xFF - color.rgbBlue;
+    }
+};
+template <>
+struct ModelCodec<ColorModel::CMYK> {
+    template <ColorFormat cf>
+    static inline Pixel decode(const uint8_t* data) {
+        Pixel rgb = ModelCodec<ColorModel::CMY>::decode<cf>(data);
+        unsigned char black = data[channelOffset(cf, 3)];
+        rgb.rgbRed -= black;
+        rgb.rgbGreen -= black;
+        rgb.rgbBlue -= black;
+        return rgb;
+    }
+    template <ColorFormat cf>
+    static inline void encode(uint8_t* data, Pixel color) {
+        unsigned char c = 0xFF - color.rgbRed;
+        unsigned char m = 0xFF - color.rgbGreen;
+        unsigned char y = 0xFF - color.rgbBlue;
+        unsigned char k = std::min(c, std::min(m, y));
+        data[channelOffset(cf, 0)] = c - k;
+        data[channelOffset(cf, 1)] = m - k;
+        data[channelOffset(cf, 2)] = y - k;
+        data[channelOffset(cf, 3)] = k;
+    }
+};
+template <>
+struct ModelCodec<ColorModel::HSL> {
+    template <ColorFormat cf>
+    static inline Pixel decode(const uint8_t* data) {
+        const uint8_t h = data[channelOffset(cf, 0)], s = data[channelOffset(cf, 1)], l = data[channelOffset(cf, 2)];
+        if (s == 0) {
+            Pixel rgb{};
+            rgb.rgbRed = l;
+            rgb.rgbGreen = l;
+            rgb.rgbBlue = l;
+            return rgb;
+        }
+        const uint8_t q = l < 128 ? l + (l*s) / 255 : l + s - (l*s) / 255;
+        const uint8_t p = 2 * l - q;
+        Pixel rgb{};
+        rgb.rgbRed = hueToRgb(p, q, h + 87);
+        rgb.rgbGreen = hueToRgb(p, q, h);
+        rgb.rgbBlue = hueToRgb(p, q, h - 87);
+        return rgb;
+    }
+    template <ColorFormat cf>
+    static inline void encode(uint8_t* data, Pixel color) {
+        const uint8_t r = color.rgbRed, g = color.rgbGreen, b = color.rgbBlue;
+        const uint8_t max = std::max(std::max(r, g), b),  min = std::min(std::min(r, g), b);
+        const uint8_t l = (max + min) / 2;
+        if (max == min) {
+            data[channelOffset(cf, 0)] = 0;
+            data[channelOffset(cf, 1)] = 0;
+            data[channelOffset(cf, 2)] = l;
+            return;
+        }
+        const uint8_t d = max - min;
+        const uint8_t s = (l > 127) ? 255 * d / (2 * 255 - max - min) : 255 * d / (max + min);
+        const uint8_t h = (max == r) ? ((g - b) * 42) / d : (max == g) ? ((b - r) * 42) / d + 84 : ((r - g) * 42) / d + 168;
+        data[channelOffset(cf, 0)] = h;
+        data[channelOffset(cf, 1)] = s;
+        data[channelOffset(cf, 2)] = l;
+    }
+};
+template <>
+struct ModelCodec<ColorModel::HSV> {
+    template <ColorFormat cf>
+    static inline Pixel decode(const uint8_t* data) {
+        const uint8_t h = data[channelOffset(cf, 0)], s = data[channelOffset(cf, 1)], v = data[channelOffset(cf, 2)];
+        if (s == 0) {
+            Pixel rgb{};
+            rgb.rgbRed = v;
+            rgb.rgbGreen = v;
+            rgb.rgbBlue = v;
+            return rgb;
+        }
+        const uint8_t i = h / 42;
+        const uint8_t ff = (h % 42) * 6;
+        const uint8_t p = (v * (255 - s)) / 255;
+        const uint8_t q = (v * ((255 * 255) - (s * ff))) / (255 * 255);
+        const uint8_t t = (v * ((255 * 255) - (s * (255 - ff)))) / (255 * 255);
+        Pixel rgb{};
+        switch (i) {
+        case 0:
+            rgb.rgbRed = v;
+            rgb.rgbGreen = t;
+            rgb.rgbBlue = p;
+            break;
+        case 1:
+            rgb.rgbRed = q;
+            rgb.rgbGreen = v;
+            rgb.rgbBlue = p;
+            break;
+        case 2:
+            rgb.rgbRed = p;
+            rgb.rgbGreen = v;
+            rgb.rgbBlue = t;
+            break;
+
+        case 3:
+            rgb.rgbRed = p;
+            rgb.rgbGreen = q;
+            rgb.rgbBlue = v;
+            break;
+        case 4:
+            rgb.rgbRed = t;
+            rgb.rgbGreen = p;
+            rgb.rgbBlue = v;
+            break;
+        case 5:
+        default:
+            rgb.rgbRed = v;
+            rgb.rgbGreen = p;
+            rgb.rgbBlue = q;
+            break;
+        }
+        return rgb;
+    }
+    template <ColorFormat cf>
+    static inline void encode(uint8_t* data, Pixel color) {
+        const uint8_t r = color.rgbRed, g = color.rgbGreen, b = color.rgbBlue;
+        const uint8_t max = std::max(std::max(r, g), b), min = std::min(std::min(r, g), b);
+        const uint8_t d = max - min;
+        if (d == 0)
+        {
+            data[channelOffset(cf, 0)] = 0;
+            data[channelOffset(cf, 1)] = 0;
+            data[channelOffset(cf, 2)] = max;
+            return;
+        }
+        const uint8_t s = 255 * d / max;
+        const uint8_t h = (max == r) ? ((g - b) * 42) / d : (max == g) ? ((b - r) * 42) / d + 84 : ((r - g) * 42) / d + 168;
+        data[channelOffset(cf, 0)] = h;
+        data[channelOffset(cf, 1)] = s;
+        data[channelOffset(cf, 2)] = max;
+    }
+};
+template <>
+struct ModelCodec<ColorModel::FloatHSL> {
+    template <ColorFormat cf>
+    static inline Pixel decode(const uint8_t* data) {
+        const double h = loadFloat64(data + channelOffset(cf, 0)), s = loadFloat64(data + channelOffset(cf, 1)), l = loadFloat64(data + channelOffset(cf, 2));
+        if (s == 0) {
+            Pixel rgb{};
+            rgb.rgbRed = pythonToByte(l * 255);
+            rgb.rgbGreen = pythonToByte(l * 255);
+            rgb.rgbBlue = pythonToByte(l * 255);
+            return rgb;
+        }
+        const double q = l < 0.5 ? l * (1 + s) : l + s - (l * s);
+        const double p = 2 * l - q;
+        Pixel rgb{};
+        rgb.rgbRed = pythonHueToRgb(p, q, h + 120);
+        rgb.rgbGreen = pythonHueToRgb(p, q, h);
+        rgb.rgbBlue = pythonHueToRgb(p, q, h - 120);
+        return rgb;
+    }
+    template <ColorFormat cf>
+    static inline void encode(uint8_t* data, Pixel color) {
+        const uint8_t r = color.rgbRed, g = color.rgbGreen, b = color.rgbBlue;
+        const uint8_t max = std::max(std::max(r, g), b), min = std::min(std::min(r, g), b);
+        const uint16_t l = max + min;
+
+        if (max == min) {
+            storeFloat64(data + channelOffset(cf, 0), 0.0);
+            storeFloat64(data + channelOffset(cf, 1), 0.0);
+            storeFloat64(data + channelOffset(cf, 2), l / 512.0);
+            return;
+        }
+
+        const uint8_t d = max - min;
+        const double s = (l > 255) ? d / static_cast<double>(2 * 255 - max - min) : d / static_cast<double>(max + min);
+        const double h = (max == r) ? ((g - b) * 60) / static_cast<double>(d) + (g < b ? 360.0 : 0.0) : (max == g) ? ((b - r) * 60) / static_cast<double>(d) + 120 : ((r - g) * 60) / static_cast<double>(d) + 240;
+        storeFloat64(data + channelOffset(cf, 0), h);
+        storeFloat64(data + channelOffset(cf, 1), s);
+        storeFloat64(data + channelOffset(cf, 2), l / 512.0);
+    }
+};
+// The model conversions are instantiated into span kernels, so the loop is compiled once per format with the call inlined.
+template <ColorFormat cf>
+static void decodeSpan(const uint8_t* src, Pixel* dst, size_t n) {
+    for (size_t i = 0; i < n; i++, src += get_formatSize(cf))
+        dst[i] = ModelCodec<get_formatLayout(cf).model>::template decode<cf>(src);
+}
+template <ColorFormat cf>
+static void encodeSpan(const Pixel* src, uint8_t* dst, size_t n) {
+    for (size_t i = 0; i < n; i++, dst += get_formatSize(cf)) {
+        for (int slot = 0; slot < get_formatLayout(cf).slotCount; slot++)
+            if (slotChannel(cf, slot) < 0) memset(dst + slot * get_formatLayout(cf).channelSize, 0, get_formatLayout(cf).channelSize);
+        ModelCodec<get_formatLayout(cf).model>::template encode<cf>(dst, src[i]);
+    }
+}
+template <size_t... formats>
+static ColorFormatDecoder scalarDecoder(ColorFormat cf, std::index_sequence<formats...>) {
+    static const ColorFormatDecoder decoders[] = { decodeSpan<static_cast<ColorFormat>(formats)>... };
+    return decoders[static_cast<int>(cf)];
+}
+template <size_t... formats>
+static ColorFormatEncoder scalarEncoder(ColorFormat cf, std::index_sequence<formats...>) {
+    static const ColorFormatEncoder encoders[] = { encodeSpan<static_cast<ColorFormat>(formats)>... };
+    return encoders[static_cast<int>(cf)];
+}
+ColorFormatDecoder get_scalarDecoder(ColorFormat cf) {
+    return scalarDecoder(cf < ColorFormat::Invalid ? cf : ColorFormat::RGBA, std::make_index_sequence<formatCount>());
+}
+ColorFormatEncoder get_scalarEncoder(ColorFormat cf) {
+    return scalarEncoder(cf < ColorFormat::Invalid ? cf : ColorFormat::RGBA, std::make_index_sequence<formatCount>());
+}
+// The tables are compiled for their instruction set, so they can't even be built before the CPU is known to support it.
+const KernelTables& get_simdKernels() {
+    static const KernelTables tables = { get_simdLevel() >= SimdLevel::avx2 ? get_avx2Kernels() : NULL,
+        get_simdLevel() >= SimdLevel::ssse3 ? get_ssse3Kernels() : NULL };
+    return tables;
+}
+static TextParser get_textParser() {
+    for (const KernelTable* table : get_simdKernels())
+        if (table != NULL && table->readtxt != NULL) return table->readtxt;
+    return readtxtScalar;
+}
+size_t readtxt(const char* text, uint8_t* data, size_t count) {
+    static const TextParser parser = get_textParser();
+    return parser(text, data, count);
+}
+static TextValidator get_textValidator() {
+    for (const KernelTable* table : get_simdKernels())
+        if (table != NULL && table->validatetxt != NULL) return table->validatetxt;
+    return validatetxtScalar;
+}
+static TextWriter get_textWriter() {
+    for (const KernelTable* table : get_simdKernels())
+        if (table != NULL && table->writetxt != NULL) return table->writetxt;
+    return writetxtScalar;
+}
+void writetxt(const uint8_t* data, char* text, size_t count) {
+    static const TextWriter writer = get_textWriter();
+    writer(data, text, count);
+}
+void validatetxt(const char* text, size_t length, size_t offset, TextError& error) {
+    static const TextValidator validator = get_textValidator();
+    size_t first = 0;
+    size_t count = validator(text, length, &first);
+    if (count != 0 && error.count == 0) error.firstOffset = offset + first;
+    error.count += count;
+}
+ColorFormatDecoder get_decoder(ColorFormat cf) {
+    if (cf < ColorFormat::Invalid)
+        for (const KernelTable* table : get_simdKernels())
+            if (table != NULL && table->decoders[static_cast<int>(cf)] != NULL) return table->decoders[static_cast<int>(cf)];
+    return get_scalarDecoder(cf);
+}
+ColorFormatEncoder get_encoder(ColorFormat cf) {
+    if (cf < ColorFormat::Invalid)
+        for (const KernelTable* table : get_simdKernels())
+            if (table != NULL && table->encoders[static_cast<int>(cf)] != NULL) return table->encoders[static_cast<int>(cf)];
+    return get_scalarEncoder(cf);
+}
+// Pixels per piece of work on the thread pool, small images aren't worth waking it up for.
+static constexpr size_t parallelGrain = 1 << 15;
+void decodePixels(const char* data, ColorFormat cf, Pixel* image, size_t count) {
+    ColorFormatDecoder decoder = get_decoder(cf);
+    size_t pixelSize = get_pixelSize(cf);
+    parallelFor(count, parallelGrain, [&](size_t begin, size_t end) {
+        decoder(reinterpret_cast<const uint8_t*>(data) + begin * pixelSize, image + begin, end - begin);
+    });
+}
+void decodeRows(const char* data, size_t stride, ColorFormat cf, Pixel* image, size_t width, size_t height) {
+    if (stride == width * get_pixelSize(cf)) {
+        decodePixels(data, cf, image, width * height);
+        return;
+    }
+    ColorFormatDecoder decoder = get_decoder(cf);
+    parallelFor(height, std::max<size_t>(parallelGrain / std::max<size_t>(width, 1), 1), [&](size_t begin, size_t end) {
+        for (size_t y = begin; y < end; y++)
+            decoder(reinterpret_cast<const uint8_t*>(data) + y * stride, image + y * width, width);
+    });
+}
+void decodeImage(const char* data, size_t dataSize, ColorFormat cf, Pixel* image, size_t imageSize) {
+    size_t loopCount = std::min(dataSize / get_pixelSize(cf), imageSize);
+    decodePixels(data, cf, image, loopCount);
+    repeatImage(image, loopCount, imageSize);
+}
+bool decodeRows(const char* data, size_t stride, ColorFormat cf, Pixel* image, size_t width, size_t height, const DecodeProgress& progress) {
+    size_t bandRows = std::max<size_t>(progressBand / std::max<size_t>(width, 1), 1);
+    for (size_t y = 0; y < height; y += bandRows) {
+        size_t rows = std::min(bandRows, height - y);
+        decodeRows(data + y * stride, stride, cf, image + y * width, width, rows);
+        if (!progress(static_cast<uint64_t>(y + rows) * width)) return false;
+    }
+    return true;
+}
+bool decodeImage(const char* data, size_t dataSize, ColorFormat cf, Pixel* image, size_t imageSize, const DecodeProgress& progress) {
+    size_t loopCount = std::min(dataSize / get_pixelSize(cf), imageSize);
+    for (size_t i = 0; i < loopCount; i += progressBand) {
+        size_t count = std::min(progressBand, loopCount - i);
+        decodePixels(data + i * get_pixelSize(cf), cf, image + i, count);
+        if (!progress(i + count)) return false;
+    }
+    // The repeated part is a few big copies, it comes all at once
+    repeatImage(image, loopCount, imageSize);
+    return loopCount == imageSize || progress(imageSize);
+}
+void repeatImage(Pixel* image, size_t count, size_t imageSize) {
+    if (count >= imageSize) return;
+    if (count == 0) {
+        parallelFor(imageSize, parallelGrain, [&](size_t begin, size_t end) {
+            memset(image + begin, 0, (end - begin) * sizeof(Pixel));
+        });
+        return;
+    }
+    // A short capture is first doubled in place until the repeating block is about a piece of work long, so every
+    // piece below is one or two big copies however few pixels were decoded
+    size_t period = count;
+    for (size_t limit = std::min(imageSize, parallelGrain); period <= limit / 2; period *= 2)
+        memcpy(image + period, image, period * sizeof(Pixel));
+    parallelFor(imageSize - period, parallelGrain, [&](size_t begin, size_t end) {
+        // Copied in runs up to the next wrap around of the source
+        for (size_t i = period + begin; i < period + end; ) {
+            size_t source = i % period, run = std::min(period - source, period + end - i);
+            memcpy(image + i, image + source, run * sizeof(Pixel));
+            i += run;
+        }
+    });
+}
+void encodeImage(const Pixel* image, size_t imageSize, ColorFormat cf, char* data) {
+    ColorFormatEncoder encoder = get_encoder(cf);
+    size_t pixelSize = get_pixelSize(cf);
+    parallelFor(imageSize, parallelGrain, [&](size_t begin, size_t end) {
+        encoder(image + begin, reinterpret_cast<uint8_t*>(data) + begin * pixelSize, end - begin);
+    });
+}
+PixelSource get_pixelSource(const Pixel* image) {
+    return [image](uint64_t first, size_t, Pixel*) { return image + first; };
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+// Portable part of the image viewer, shared by the GUI and ikt-convert. Nothing in here may depend on Win32.
+
+enum class ImageFormat {
+    invalid,
+    txt,
+    bin,
+    ikt,    // .bin pixels behind a header, see ImageHeader.h
+    iktz,   // compressed .ikt, see Compression.h
+    qoi,    // see Qoi.h
+};
+
+enum class ColorFormat {
+    RGBA, RGB, ARGB, BGRA, BGR, ABGR, BAGR,
+    GrayScale,
+    CMY, CMYK, HSL, HSLA, HSV, HSVA,
+    Python, Invalid,
+};
+
+// Same memory layout as the Win32 RGBQUAD, so pixels can be decoded straight into a DIB section.
+struct Pixel {
+    uint8_t rgbBlue;
+    uint8_t rgbGreen;
+    uint8_t rgbRed;
+    uint8_t rgbReserved;
+};
+
+// Convert n pixels at once, src/dst advance by get_pixelSize bytes per pixel on the raw side.
+typedef void(*ColorFormatDecoder)(const uint8_t* src, Pixel* dst, size_t n);
+typedef void(*ColorFormatEncoder)(const Pixel* src, uint8_t* dst, size_t n);
+
+ImageFormat get_imageFormat(const char* path);
+ImageFormat get_imageFormat(const wchar_t* path);
+// Returns ColorFormat::Invalid for unknown names, an empty name means RGBA.
+ColorFormat parseColorFormat(const char* name);
+ColorFormat parseColorFormat(const wchar_t* name);
+// The name parseColorFormat knows cf by, NULL for ColorFormat::Invalid.
+const char* get_colorFormatName(ColorFormat cf);
+size_t get_pixelSize(ColorFormat cf);
+ColorFormatDecoder get_decoder(ColorFormat cf);
+ColorFormatEncoder get_encoder(ColorFormat cf);
+
+// .txt files store bytes as sequences of '0' and '1', most significant bit first.
+// Converts count * 8 characters into count bytes and stops at the first byte containing anything but '0' or '1'.
+// Returns the number of bytes converted, data may point into text.
+typedef size_t(*TextParser)(const char* text, uint8_t* data, size_t count);
+size_t readtxt(const char* text, uint8_t* data, size_t count);
+// Characters other than '0' and '1' found by validatetxt, offsets are in characters from the start of the file.
+struct TextError {
+    size_t count = 0;
+    size_t firstOffset = 0;
+};
+// Counts the invalid characters in one pass without converting anything. A file can be checked in pieces,
+// offset is where text starts in the file and the counts accumulate in error.
+typedef size_t(*TextValidator)(const char* text, size_t length, size_t* first);
+void validatetxt(const char* text, size_t length, size_t offset, TextError& error);
+// Expands count bytes into count * 8 characters.
+typedef void(*TextWriter)(const uint8_t* data, char* text, size_t count);
+void writetxt(const uint8_t* data, char* text, size_t count);
+
+// Decodes count pixels, spread over the thread pool.
+void decodePixels(const char* data, ColorFormat cf, Pixel* image, size_t count);
+// Decodes height rows of width pixels that start stride bytes apart, spread over the thread pool like decodePixels.
+void decodeRows(const char* data, size_t stride, ColorFormat cf, Pixel* image, size_t width, size_t height);
+// Decodes as many pixels as data holds, overflow repeats the image. Pixels are black if data holds none.
+void decodeImage(const char* data, size_t dataSize, ColorFormat cf, Pixel* image, size_t imageSize);
+// Fills the rest of the image after the first count decoded pixels the same way.
+void repeatImage(Pixel* image, size_t count, size_t imageSize);
+// Told how many pixels from the start of the image are decoded, returns false to stop decoding there. Called a
+// progressBand of pixels or so apart, with every pixel once decoding is done.
+typedef std::function<bool(uint64_t decoded)> DecodeProgress;
+static constexpr size_t progressBand = 1 << 20;
+// decodeRows and decodeImage in bands reported to progress as they finish. Return false if progress stopped them.
+bool decodeRows(const char* data, size_t stride, ColorFormat cf, Pixel* image, size_t width, size_t height, const DecodeProgress& progress);
+bool decodeImage(const char* data, size_t dataSize, ColorFormat cf, Pixel* image, size_t imageSize, const DecodeProgress& progress);
+// data must hold imageSize * get_pixelSize(cf) bytes. Spread over the thread pool like decodePixels.
+void encodeImage(const Pixel* image, size_t imageSize, ColorFormat cf, char* data);
+// Hands out the pixels of an image that may not be in memory: returns count pixels in row order from first on, either
+// where they are or copied into scratch, which has room for count pixels. Called from several threads at once.
+typedef std::function<const Pixel*(uint64_t first, size_t count, Pixel* scratch)> PixelSource;
+// The source for an image that is in memory.
+PixelSource get_pixelSource(const Pixel* image);
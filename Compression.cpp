@@ -0,0 +1,326 @@
+#include "Compression.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+static const uint8_t compressedMagic[4] = { 'I', 'K', 'Z', 0x1A };
+// Raw bytes per block, small enough for every thread to get some of a large image and large enough to compress well
+static constexpr size_t blockBytes = 1 << 19;
+// Larger blocks in a file are refused instead of allocated
+static constexpr uint64_t maxBlockBytes = 1 << 30;
+static constexpr size_t minMatch = 4;
+static constexpr size_t maxOffset = 65535;
+static constexpr int hashBits = 14;
+// Pixels an encoding thread takes from the source at a time
+static constexpr size_t sourcePixels = 1 << 16;
+
+static uint64_t loadLittle(const uint8_t* data, int size) {
+    uint64_t value = 0;
+    for (int i = size - 1; i >= 0; i--) value = value << 8 | data[i];
+    return value;
+}
+static void storeLittle(uint8_t* data, uint64_t value, int size) {
+    for (int i = 0; i < size; i++, value >>= 8) data[i] = static_cast<uint8_t>(value);
+}
+static uint32_t load32(const uint8_t* data) {
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+static uint64_t load64(const uint8_t* data) {
+    uint64_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+// Rows of a block as differences to the row above, in place. Both loops vectorize.
+static void subtractRows(uint8_t* rows, size_t rowBytes, size_t rowCount) {
+    for (size_t r = rowCount - 1; r > 0; r--) {
+        uint8_t* row = rows + r * rowBytes;
+        const uint8_t* above = row - rowBytes;
+        for (size_t x = 0; x < rowBytes; x++) row[x] = static_cast<uint8_t>(row[x] - above[x]);
+    }
+}
+static void addRows(uint8_t* rows, size_t rowBytes, size_t rowCount) {
+    for (size_t r = 1; r < rowCount; r++) {
+        uint8_t* row = rows + r * rowBytes;
+        const uint8_t* above = row - rowBytes;
+        for (size_t x = 0; x < rowBytes; x++) row[x] = static_cast<uint8_t>(row[x] + above[x]);
+    }
+}
+
+// The most compressBlock can write for size bytes, when nothing matches.
+static size_t compressBound(size_t size) {
+    return size + size / 255 + 16;
+}
+// No compressed byte expands into more than this many, a 255 length byte being the most.
+static constexpr uint64_t maxExpansion = 255;
+static uint8_t* writeLength(uint8_t* out, size_t length) {
+    for (; length >= 255; length -= 255) *out++ = 255;
+    *out++ = static_cast<uint8_t>(length);
+    return out;
+}
+// A match length of 0 ends the block after the literals.
+static uint8_t* writeSequence(uint8_t* out, const uint8_t* literals, size_t literalCount, size_t offset, size_t matchLength) {
+    size_t matchCode = matchLength == 0 ? 0 : matchLength - minMatch;
+    *out++ = static_cast<uint8_t>(std::min<size_t>(literalCount, 15) << 4 | std::min<size_t>(matchCode, 15));
+    if (literalCount >= 15) out = writeLength(out, literalCount - 15);
+    memcpy(out, literals, literalCount);
+    out += literalCount;
+    if (matchLength == 0) return out;
+    storeLittle(out, offset, 2);
+    out += 2;
+    if (matchCode >= 15) out = writeLength(out, matchCode - 15);
+    return out;
+}
+// Greedy matching against the last position every 4 byte sequence was seen at, skipping ahead faster the longer
+// nothing matches. table holds 1 << hashBits entries. Returns the compressed size.
+static size_t compressBlock(const uint8_t* src, size_t size, uint8_t* dst, uint32_t* table) {
+    memset(table, 0, sizeof(uint32_t) << hashBits);
+    uint8_t* out = dst;
+    size_t anchor = 0, i = 0;
+    while (i + minMatch <= size) {
+        uint32_t sequence = load32(src + i);
+        uint32_t& slot = table[sequence * 2654435761u >> (32 - hashBits)];
+        // Positions are stored + 1 so 0 means empty
+        size_t candidate = slot;
+        slot = static_cast<uint32_t>(i + 1);
+        if (candidate == 0 || i - (candidate - 1) > maxOffset || load32(src + candidate - 1) != sequence) {
+            i += 1 + ((i - anchor) >> 6);
+            continue;
+        }
+        size_t match = candidate - 1, length = minMatch;
+        while (i + length + 8 <= size && load64(src + match + length) == load64(src + i + length)) length += 8;
+        while (i + length < size && src[match + length] == src[i + length]) length++;
+        out = writeSequence(out, src + anchor, i - anchor, i - match, length);
+        i += length;
+        anchor = i;
+    }
+    out = writeSequence(out, src + anchor, size - anchor, 0, 0);
+    return out - dst;
+}
+static bool readLength(const uint8_t*& in, const uint8_t* end, size_t& length) {
+    uint8_t byte;
+    do {
+        if (in == end) return false;
+        byte = *in++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+// Doubling the piece copied each time keeps the source and destination apart while repeating the pattern.
+static void copyMatch(uint8_t* out, size_t offset, size_t length) {
+    const uint8_t* match = out - offset;
+    if (offset == 1) {
+        memset(out, *match, length);
+        return;
+    }
+    while (length > 0) {
+        size_t piece = std::min(length, static_cast<size_t>(out - match));
+        memcpy(out, match, piece);
+        out += piece;
+        length -= piece;
+    }
+}
+// Returns false unless src decompresses into exactly size bytes.
+static bool decompressBlock(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t size) {
+    const uint8_t* in = src;
+    const uint8_t* end = src + srcSize;
+    uint8_t* out = dst;
+    uint8_t* outEnd = dst + size;
+    while (in < end) {
+        unsigned token = *in++;
+        size_t literalCount = token >> 4;
+        if (literalCount == 15 && !readLength(in, end, literalCount)) return false;
+        if (literalCount > static_cast<size_t>(end - in) || literalCount > static_cast<size_t>(outEnd - out)) return false;
+        memcpy(out, in, literalCount);
+        in += literalCount;
+        out += literalCount;
+        if (in == end) break;
+        if (end - in < 2) return false;
+        size_t offset = static_cast<size_t>(loadLittle(in, 2));
+        in += 2;
+        size_t length = token & 15;
+        if (length == 15 && !readLength(in, end, length)) return false;
+        length += minMatch;
+        if (offset == 0 || offset > static_cast<size_t>(out - dst) || length > static_cast<size_t>(outEnd - out)) return false;
+        copyMatch(out, offset, length);
+        out += length;
+    }
+    return out == outEnd;
+}
+
+// Buffers of size elements for the pieces of one decode or encode to share, so a thread allocates at most one of them
+// however many groups of blocks it works on. Running out of memory throws std::bad_alloc, which parallelFor passes on.
+template <typename T>
+class ScratchBuffers {
+public:
+    explicit ScratchBuffers(size_t size) : size(size) {}
+    T* take() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!unused.empty()) {
+            T* buffer = unused.back();
+            unused.pop_back();
+            return buffer;
+        }
+        std::unique_ptr<T[]> buffer(new T[size]);
+        buffers.push_back(std::move(buffer));
+        // So give never allocates
+        unused.reserve(buffers.size());
+        return buffers.back().get();
+    }
+    void give(T* buffer) {
+        std::lock_guard<std::mutex> lock(mutex);
+        unused.push_back(buffer);
+    }
+
+private:
+    size_t size;
+    std::mutex mutex;
+    std::vector<std::unique_ptr<T[]>> buffers;
+    std::vector<T*> unused;
+};
+
+// Calls body(index, data, size) for every block in the file, stops at the first block that doesn't fit.
+template <typename Body>
+static bool forEachBlock(const uint8_t* data, uint64_t fileSize, uint64_t blockCount, Body body) {
+    uint64_t offset = compressedHeaderSize;
+    for (uint64_t i = 0; i < blockCount; i++) {
+        if (fileSize - offset < 8) return false;
+        uint64_t size = loadLittle(data + offset, 8);
+        offset += 8;
+        if (size > fileSize - offset) return false;
+        body(i, data + offset, static_cast<size_t>(size));
+        offset += size;
+    }
+    return true;
+}
+
+HeaderStatus readCompressedHeader(const uint8_t* data, uint64_t fileSize, CompressedHeader& header) {
+    if (fileSize < compressedHeaderSize || memcmp(data, compressedMagic, sizeof(compressedMagic)) != 0) return HeaderStatus::invalid;
+    if (loadLittle(data + 4, 2) > compressedHeaderVersion) return HeaderStatus::newerVersion;
+    uint64_t cf = loadLittle(data + 6, 2);
+    if (cf >= static_cast<uint64_t>(ColorFormat::Invalid)) return HeaderStatus::invalid;
+    header.cf = static_cast<ColorFormat>(cf);
+    header.width = loadLittle(data + 8, 8);
+    header.height = loadLittle(data + 16, 8);
+    header.rowsPerBlock = loadLittle(data + 24, 8);
+    if (header.width == 0 || header.height == 0 || header.rowsPerBlock == 0) return HeaderStatus::invalid;
+    if (header.width > maxBlockBytes) return HeaderStatus::invalid;
+    uint64_t rowBytes = header.width * get_pixelSize(header.cf);
+    if (rowBytes > maxBlockBytes || std::min(header.rowsPerBlock, header.height) > maxBlockBytes / rowBytes) return HeaderStatus::invalid;
+    uint64_t blockCount = (header.height - 1) / header.rowsPerBlock + 1;
+    // Every block has to be large enough to expand into its rows, so a few bytes can't ask for a block sized buffer
+    uint64_t rowsPerBlock = std::min(header.rowsPerBlock, header.height);
+    bool fits = true;
+    if (!forEachBlock(data, fileSize, blockCount, [&](uint64_t i, const uint8_t*, size_t size) {
+        uint64_t rows = std::min(rowsPerBlock, header.height - i * rowsPerBlock);
+        if (rows * rowBytes > size * maxExpansion) fits = false;
+    })) return HeaderStatus::truncated;
+    return fits ? HeaderStatus::ok : HeaderStatus::invalid;
+}
+// Decodes the blocks in groups of about groupPixels, a group at a time on the thread pool, and reports each group.
+static bool decodeGroups(const uint8_t* data, uint64_t fileSize, const CompressedHeader& header, Pixel* image, size_t groupPixels,
+    const DecodeProgress& progress) {
+    size_t width = static_cast<size_t>(header.width), height = static_cast<size_t>(header.height);
+    size_t rowsPerBlock = static_cast<size_t>(std::min(header.rowsPerBlock, header.height));
+    size_t rowBytes = width * get_pixelSize(header.cf);
+    size_t blockCount = (height - 1) / rowsPerBlock + 1;
+    std::vector<const uint8_t*> blocks(blockCount);
+    std::vector<size_t> sizes(blockCount);
+    if (!forEachBlock(data, fileSize, blockCount, [&](uint64_t i, const uint8_t* block, size_t size) {
+        blocks[i] = block;
+        sizes[i] = size;
+    })) return false;
+    ColorFormatDecoder decoder = get_decoder(header.cf);
+    // Every thread gets a block of each group
+    size_t groupBlocks = std::max(groupPixels / std::max<size_t>(rowsPerBlock * width, 1), get_threadCount());
+    ScratchBuffers<uint8_t> raws(rowsPerBlock * rowBytes);
+    for (size_t group = 0; group < blockCount; group += groupBlocks) {
+        std::atomic<bool> ok(true);
+        parallelFor(std::min(groupBlocks, blockCount - group), 1, [&](size_t begin, size_t end) {
+            uint8_t* raw = raws.take();
+            for (size_t i = group + begin; i < group + end; i++) {
+                size_t first = i * rowsPerBlock, rows = std::min(rowsPerBlock, height - first);
+                if (!decompressBlock(blocks[i], sizes[i], raw, rows * rowBytes)) {
+                    ok = false;
+                    continue;
+                }
+                addRows(raw, rowBytes, rows);
+                decoder(raw, image + first * width, rows * width);
+            }
+            raws.give(raw);
+        });
+        size_t end = std::min(group + groupBlocks, blockCount);
+        if (!ok || !progress(static_cast<uint64_t>(std::min(end * rowsPerBlock, height)) * width)) return false;
+    }
+    return true;
+}
+bool decodeCompressed(const uint8_t* data, uint64_t fileSize, const CompressedHeader& header, Pixel* image) {
+    return decodeGroups(data, fileSize, header, image, SIZE_MAX, [](uint64_t) { return true; });
+}
+bool decodeCompressed(const uint8_t* data, uint64_t fileSize, const CompressedHeader& header, Pixel* image, const DecodeProgress& progress) {
+    return decodeGroups(data, fileSize, header, image, progressBand, progress);
+}
+bool encodeCompressed(OutputFile& file, ColorFormat cf, const Pixel* image, uint64_t width, uint64_t height) {
+    return encodeCompressed(file, cf, get_pixelSource(image), width, height);
+}
+uint64_t get_compressedMaxWidth(ColorFormat cf) {
+    return maxBlockBytes / get_pixelSize(cf);
+}
+bool encodeCompressed(OutputFile& file, ColorFormat cf, const PixelSource& source, uint64_t width, uint64_t height) {
+    // A block holds at least a row, the reader refuses blocks over maxBlockBytes
+    if (width > get_compressedMaxWidth(cf)) return false;
+    size_t rowBytes = static_cast<size_t>(width) * get_pixelSize(cf);
+    size_t rowsPerBlock = std::min<size_t>(std::max<size_t>(blockBytes / rowBytes, 1), static_cast<size_t>(height));
+    size_t blockCount = static_cast<size_t>((height - 1) / rowsPerBlock + 1);
+    uint8_t header[compressedHeaderSize];
+    memcpy(header, compressedMagic, sizeof(compressedMagic));
+    storeLittle(header + 4, compressedHeaderVersion, 2);
+    storeLittle(header + 6, static_cast<uint64_t>(cf), 2);
+    storeLittle(header + 8, width, 8);
+    storeLittle(header + 16, height, 8);
+    storeLittle(header + 24, rowsPerBlock, 8);
+    if (!file.write(header, sizeof(header))) return false;
+    // A few blocks per thread are compressed at a time and written in order before the next ones
+    // Blocks of rows wider than blockBytes are batched fewer at a time, so the batch stays about the same size
+    ColorFormatEncoder encoder = get_encoder(cf);
+    size_t pixelSize = get_pixelSize(cf);
+    size_t blockSize = rowsPerBlock * rowBytes;
+    size_t batchSize = std::min(get_threadCount() * 2, blockCount);
+    batchSize = std::min(batchSize, std::max<size_t>(get_threadCount() * 2 * blockBytes / blockSize, 1));
+    std::unique_ptr<uint8_t[]> compressed(new uint8_t[batchSize * (8 + compressBound(blockSize))]);
+    std::vector<size_t> sizes(batchSize);
+    ScratchBuffers<uint8_t> raws(blockSize);
+    ScratchBuffers<uint32_t> tables(size_t(1) << hashBits);
+    ScratchBuffers<Pixel> scratches(sourcePixels);
+    for (size_t batch = 0; batch < blockCount; batch += batchSize) {
+        size_t count = std::min(batchSize, blockCount - batch);
+        parallelFor(count, 1, [&](size_t begin, size_t end) {
+            uint8_t* raw = raws.take();
+            uint32_t* table = tables.take();
+            Pixel* scratch = scratches.take();
+            for (size_t k = begin; k < end; k++) {
+                size_t first = (batch + k) * rowsPerBlock, rows = std::min(rowsPerBlock, static_cast<size_t>(height) - first);
+                for (size_t done = 0; done < rows * width; done += sourcePixels) {
+                    size_t n = std::min(sourcePixels, rows * width - done);
+                    encoder(source(first * width + done, n, scratch), raw + done * pixelSize, n);
+                }
+                subtractRows(raw, rowBytes, rows);
+                uint8_t* out = compressed.get() + k * (8 + compressBound(blockSize));
+                sizes[k] = compressBlock(raw, rows * rowBytes, out + 8, table);
+                storeLittle(out, sizes[k], 8);
+            }
+            raws.give(raw);
+            tables.give(table);
+            scratches.give(scratch);
+        });
+        for (size_t k = 0; k < count; k++)
+            if (!file.write(compressed.get() + k * (8 + compressBound(blockSize)), 8 + sizes[k])) return false;
+    }
+    return true;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "Codec.h"
+#include "FileStream.h"
+#include "ImageHeader.h"
+
+// .iktz files hold the raw bytes of an .ikt payload compressed in independent blocks of rows, so both directions run
+// on the thread pool. All fields are little endian:
+//   0  "IKZ" 0x1A
+//   4  uint16 version, readers reject newer ones
+//   6  uint16 ColorFormat
+//   8  uint64 width
+//  16  uint64 height
+//  24  uint64 rows per block, the last block may have fewer
+//  32  the blocks, each one a uint64 compressed size followed by that many bytes
+// Every row of a block but the first is stored as its byte by byte difference to the row above, which turns the flat
+// areas of screen captures into zeros, and the result is LZ compressed with byte aligned sequences like LZ4:
+//   token       literal count in the high 4 bits, match length - 4 in the low 4 bits, 15 continues in 255 bytes
+//   literals
+//   offset      uint16 distance back to the match, 1 repeats the last byte, left out after the last literals
+struct CompressedHeader {
+    ColorFormat cf = ColorFormat::Invalid;
+    uint64_t width = 0, height = 0;
+    uint64_t rowsPerBlock = 0;
+};
+static constexpr uint16_t compressedHeaderVersion = 1;
+static constexpr size_t compressedHeaderSize = 32;
+
+// Checks the header, that every block fits in the file and that it's large enough for the rows it holds.
+HeaderStatus readCompressedHeader(const uint8_t* data, uint64_t fileSize, CompressedHeader& header);
+// Decodes all of the file into image, width * height pixels. Returns false if a block is corrupt, throws
+// std::bad_alloc if there isn't the memory for a block on every thread.
+bool decodeCompressed(const uint8_t* data, uint64_t fileSize, const CompressedHeader& header, Pixel* image);
+// decodeCompressed a few blocks at a time, reporting each group of blocks to progress. Also returns false if progress
+// stopped it.
+bool decodeCompressed(const uint8_t* data, uint64_t fileSize, const CompressedHeader& header, Pixel* image, const DecodeProgress& progress);
+// The widest rows in cf an .iktz block holds, readCompressedHeader refuses wider ones.
+uint64_t get_compressedMaxWidth(ColorFormat cf);
+// Encodes the image into cf and writes it as an .iktz file. Returns false if the file couldn't be written, or without
+// writing anything if the rows are wider than get_compressedMaxWidth. Throws std::bad_alloc like decodeCompressed.
+bool encodeCompressed(OutputFile& file, ColorFormat cf, const Pixel* image, uint64_t width, uint64_t height);
+// encodeCompressed for images that aren't in memory as a whole, every block takes its rows from source.
+bool encodeCompressed(OutputFile& file, ColorFormat cf, const PixelSource& source, uint64_t width, uint64_t height);
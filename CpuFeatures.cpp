@@ -0,0 +1,80 @@
+#include "CpuFeatures.h"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define IKT_X86 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#define IKT_X86 1
+#endif
+
+static const char* const levelNames[] = { "scalar", "ssse3", "avx2" };
+
+#ifdef IKT_X86
+static void cpuid(unsigned leaf, unsigned subleaf, unsigned regs[4]) {
+#ifdef _MSC_VER
+    int values[4];
+    __cpuidex(values, static_cast<int>(leaf), static_cast<int>(subleaf));
+    for (int i = 0; i < 4; i++) regs[i] = static_cast<unsigned>(values[i]);
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+// Register state the operating system saves on context switches
+static uint64_t enabledState() {
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    uint32_t low, high;
+    __asm__ volatile("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+    return static_cast<uint64_t>(high) << 32 | low;
+#endif
+}
+static SimdLevel detectLevel() {
+    unsigned regs[4];
+    cpuid(0, 0, regs);
+    unsigned maxLeaf = regs[0];
+    if (maxLeaf < 1) return SimdLevel::scalar;
+    cpuid(1, 0, regs);
+    if (!(regs[2] & (1u << 9))) return SimdLevel::scalar;
+    // AVX2 also needs AVX and the OS saving the YMM registers, XCR0 bits 1 and 2
+    bool avx = (regs[2] & (1u << 27)) && (regs[2] & (1u << 28)) && (enabledState() & 6) == 6;
+    if (!avx || maxLeaf < 7) return SimdLevel::ssse3;
+    cpuid(7, 0, regs);
+    return (regs[1] & (1u << 5)) ? SimdLevel::avx2 : SimdLevel::ssse3;
+}
+#else
+static SimdLevel detectLevel() {
+    return SimdLevel::scalar;
+}
+#endif
+
+static SimdLevel requestedLevel(SimdLevel supported) {
+    SimdLevel level = supported;
+#ifdef _MSC_VER
+    // getenv is deprecated with SDL checks
+    char* value = nullptr;
+    size_t length;
+    if (_dupenv_s(&value, &length, "IKT_SIMD") != 0 || value == nullptr) return level;
+#else
+    const char* value = getenv("IKT_SIMD");
+    if (value == nullptr) return level;
+#endif
+    for (int i = 0; i <= static_cast<int>(supported); i++)
+        if (strcmp(value, levelNames[i]) == 0) level = static_cast<SimdLevel>(i);
+#ifdef _MSC_VER
+    free(value);
+#endif
+    return level;
+}
+
+SimdLevel get_simdLevel() {
+    static const SimdLevel level = requestedLevel(detectLevel());
+    return level;
+}
+const char* get_simdLevelName(SimdLevel level) {
+    return levelNames[static_cast<int>(level)];
+}
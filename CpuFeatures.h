@@ -0,0 +1,15 @@
+#pragma once
+
+// Instruction sets the SIMD kernels are built for, from oldest to newest.
+enum class SimdLevel {
+    scalar,
+    ssse3,
+    avx2,
+    // No AVX-512 level: the kernels shuffle bytes within 128-bit lanes and are bound by memory bandwidth, so wider
+    // registers gain little, while many CPUs lower their clock while running AVX-512 code.
+};
+
+// The best level the CPU and the operating system support, detected once. The IKT_SIMD environment variable
+// (scalar, ssse3 or avx2) lowers it for benchmarking and debugging, levels the CPU doesn't support are ignored.
+SimdLevel get_simdLevel();
+const char* get_simdLevelName(SimdLevel level);
@@ -0,0 +1,167 @@
+#include "FileStream.h"
+#include <algorithm>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+InputFile::~InputFile() {
+    close();
+}
+#ifdef _WIN32
+bool InputFile::open(const char* path) {
+    wchar_t wpath[MAX_PATH];
+    if (MultiByteToWideChar(CP_UTF8, 0, path, -1, wpath, MAX_PATH) == 0) return false;
+    return open(wpath);
+}
+bool InputFile::open(const wchar_t* path) {
+    close();
+    HANDLE handle = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (handle == INVALID_HANDLE_VALUE) return false;
+    file = handle;
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(handle, &fileSize)) {
+        close();
+        return false;
+    }
+    length = static_cast<uint64_t>(fileSize.QuadPart);
+    return true;
+}
+void InputFile::close() {
+    if (file != nullptr) CloseHandle(file);
+    file = nullptr;
+    length = 0;
+}
+bool InputFile::read(void* buffer, size_t size, size_t& count) {
+    // ReadFile takes at most a DWORD
+    count = 0;
+    while (count < size) {
+        DWORD done;
+        DWORD piece = static_cast<DWORD>(std::min(size - count, (size_t)1 << 30));
+        if (!ReadFile(file, static_cast<char*>(buffer) + count, piece, &done, NULL)) return false;
+        if (done == 0) break;
+        count += done;
+    }
+    return true;
+}
+
+OutputFile::~OutputFile() {
+    close();
+}
+bool OutputFile::open(const char* path) {
+    wchar_t wpath[MAX_PATH];
+    if (MultiByteToWideChar(CP_UTF8, 0, path, -1, wpath, MAX_PATH) == 0) return false;
+    return open(wpath);
+}
+bool OutputFile::open(const wchar_t* path) {
+    close();
+    HANDLE handle = CreateFileW(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (handle == INVALID_HANDLE_VALUE) return false;
+    file = handle;
+    return true;
+}
+bool OutputFile::close() {
+    bool ok = file == nullptr || CloseHandle(file);
+    file = nullptr;
+    return ok;
+}
+bool OutputFile::write(const void* buffer, size_t size) {
+    // WriteFile takes at most a DWORD, larger buffers are written in pieces
+    const char* data = static_cast<const char*>(buffer);
+    while (size > 0) {
+        DWORD written;
+        if (!WriteFile(file, data, static_cast<DWORD>(std::min(size, (size_t)1 << 30)), &written, NULL)) return false;
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+bool isSameFile(const char* first, const char* second) {
+    wchar_t wfirst[MAX_PATH], wsecond[MAX_PATH];
+    if (MultiByteToWideChar(CP_UTF8, 0, first, -1, wfirst, MAX_PATH) == 0 || MultiByteToWideChar(CP_UTF8, 0, second, -1, wsecond, MAX_PATH) == 0) return false;
+    return isSameFile(wfirst, wsecond);
+}
+// Opens path without access to the data, for its identity only
+static HANDLE openIdentity(const wchar_t* path) {
+    return CreateFileW(path, 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+}
+bool isSameFile(const wchar_t* first, const wchar_t* second) {
+    HANDLE handles[2] = { openIdentity(first), openIdentity(second) };
+    BY_HANDLE_FILE_INFORMATION info[2];
+    bool same = handles[0] != INVALID_HANDLE_VALUE && handles[1] != INVALID_HANDLE_VALUE &&
+        GetFileInformationByHandle(handles[0], &info[0]) && GetFileInformationByHandle(handles[1], &info[1]) &&
+        info[0].dwVolumeSerialNumber == info[1].dwVolumeSerialNumber &&
+        info[0].nFileIndexHigh == info[1].nFileIndexHigh && info[0].nFileIndexLow == info[1].nFileIndexLow;
+    for (HANDLE handle : handles) {
+        if (handle != INVALID_HANDLE_VALUE) CloseHandle(handle);
+    }
+    return same;
+}
+#else
+bool InputFile::open(const char* path) {
+    close();
+    fd = ::open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close();
+        return false;
+    }
+    length = static_cast<uint64_t>(info.st_size);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return true;
+}
+void InputFile::close() {
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+    length = 0;
+}
+bool InputFile::read(void* buffer, size_t size, size_t& count) {
+    count = 0;
+    while (count < size) {
+        ssize_t done = ::read(fd, static_cast<char*>(buffer) + count, size - count);
+        if (done < 0 && errno == EINTR) continue;
+        if (done < 0) return false;
+        if (done == 0) break;
+        count += static_cast<size_t>(done);
+    }
+    return true;
+}
+
+OutputFile::~OutputFile() {
+    close();
+}
+bool OutputFile::open(const char* path) {
+    close();
+    fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    return fd >= 0;
+}
+bool OutputFile::close() {
+    bool ok = fd < 0 || ::close(fd) == 0;
+    fd = -1;
+    return ok;
+}
+bool OutputFile::write(const void* buffer, size_t size) {
+    const char* data = static_cast<const char*>(buffer);
+    while (size > 0) {
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0 && errno == EINTR) continue;
+        if (written < 0) return false;
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+bool isSameFile(const char* first, const char* second) {
+    struct stat info[2];
+    return stat(first, &info[0]) == 0 && stat(second, &info[1]) == 0 && info[0].st_dev == info[1].st_dev && info[0].st_ino == info[1].st_ino;
+}
+#endif
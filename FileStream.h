@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Sequential unbuffered file reads and writes, for files that are streamed instead of mapped.
+class InputFile {
+public:
+    InputFile() = default;
+    InputFile(const InputFile&) = delete;
+    InputFile& operator=(const InputFile&) = delete;
+    ~InputFile();
+
+    bool open(const char* path);
+#ifdef _WIN32
+    bool open(const wchar_t* path);
+#endif
+    void close();
+
+    uint64_t size() const { return length; }
+    // Fills buffer unless the file ends first, count is the number of bytes read.
+    bool read(void* buffer, size_t size, size_t& count);
+
+private:
+    uint64_t length = 0;
+#ifdef _WIN32
+    void* file = nullptr;
+#else
+    int fd = -1;
+#endif
+};
+
+class OutputFile {
+public:
+    OutputFile() = default;
+    OutputFile(const OutputFile&) = delete;
+    OutputFile& operator=(const OutputFile&) = delete;
+    ~OutputFile();
+
+    // Creates the file or truncates an existing one.
+    bool open(const char* path);
+#ifdef _WIN32
+    bool open(const wchar_t* path);
+#endif
+    // Returns false if anything written since open didn't make it to the file.
+    bool close();
+
+    bool write(const void* buffer, size_t size);
+
+private:
+#ifdef _WIN32
+    void* file = nullptr;
+#else
+    int fd = -1;
+#endif
+};
+
+// Returns true if both paths lead to the same existing file, however they are spelled and through links too.
+bool isSameFile(const char* first, const char* second);
+#ifdef _WIN32
+bool isSameFile(const wchar_t* first, const wchar_t* second);
+#endif
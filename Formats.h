@@ -0,0 +1,59 @@
+#pragma once
+
+#include "Codec.h"
+
+// How the raw bytes of every ColorFormat are laid out. The scalar kernels, the SIMD kernel tables and the format names
+// are all generated from formatLayouts, so a new layout of an existing color model only needs an enum value and a row here.
+enum class ColorModel {
+    RGB,        // red, green, blue
+    Gray,       // one value for all three channels
+    CMY,        // cyan, magenta, yellow
+    CMYK,       // cyan, magenta, yellow, black
+    HSL,        // hue with 255 for the full circle, saturation, lightness
+    HSV,        // hue, saturation, value
+    FloatHSL,   // hue in degrees, saturation and lightness from 0 to 1, as little endian float64
+};
+
+struct FormatLayout {
+    const char* name;
+    ColorModel model;
+    int channelSize;    // bytes per channel
+    int slotCount;      // channels per pixel, slots no channel of the model uses are padding and written as 0
+    int slots[4];       // the slot of every channel of the model in the order above, -1 past the model's channels
+};
+
+static constexpr FormatLayout formatLayouts[] = {
+    { "RGBA", ColorModel::RGB, 1, 4, { 0, 1, 2, -1 } },
+    { "RGB", ColorModel::RGB, 1, 3, { 0, 1, 2, -1 } },
+    { "ARGB", ColorModel::RGB, 1, 4, { 1, 2, 3, -1 } },
+    { "BGRA", ColorModel::RGB, 1, 4, { 2, 1, 0, -1 } },
+    { "BGR", ColorModel::RGB, 1, 3, { 2, 1, 0, -1 } },
+    { "ABGR", ColorModel::RGB, 1, 4, { 3, 2, 1, -1 } },
+    { "BAGR", ColorModel::RGB, 1, 4, { 3, 2, 0, -1 } },
+    { "GrayScale", ColorModel::Gray, 1, 1, { 0, -1, -1, -1 } },
+    { "CMY", ColorModel::CMY, 1, 3, { 0, 1, 2, -1 } },
+    { "CMYK", ColorModel::CMYK, 1, 4, { 0, 1, 2, 3 } },
+    { "HSL", ColorModel::HSL, 1, 3, { 0, 1, 2, -1 } },
+    { "HSLA", ColorModel::HSL, 1, 4, { 0, 1, 2, -1 } },
+    { "HSV", ColorModel::HSV, 1, 3, { 0, 1, 2, -1 } },
+    { "HSVA", ColorModel::HSV, 1, 4, { 0, 1, 2, -1 } },
+    { "Python", ColorModel::FloatHSL, 8, 4, { 0, 1, 2, -1 } },
+};
+static constexpr size_t formatCount = static_cast<size_t>(ColorFormat::Invalid);
+static_assert(sizeof(formatLayouts) / sizeof(formatLayouts[0]) == formatCount, "every ColorFormat needs a layout");
+
+static constexpr const FormatLayout& get_formatLayout(ColorFormat cf) {
+    return formatLayouts[static_cast<int>(cf)];
+}
+static constexpr int get_formatSize(ColorFormat cf) {
+    return get_formatLayout(cf).channelSize * get_formatLayout(cf).slotCount;
+}
+// Byte offset of a channel of the model in the raw pixel, -1 if the model doesn't have it.
+static constexpr int channelOffset(ColorFormat cf, int channel) {
+    return get_formatLayout(cf).slots[channel] < 0 ? -1 : get_formatLayout(cf).slots[channel] * get_formatLayout(cf).channelSize;
+}
+// The channel stored in a slot, -1 for padding.
+static constexpr int slotChannel(ColorFormat cf, int slot) {
+    return get_formatLayout(cf).slots[0] == slot ? 0 : get_formatLayout(cf).slots[1] == slot ? 1 :
+        get_formatLayout(cf).slots[2] == slot ? 2 : get_formatLayout(cf).slots[3] == slot ? 3 : -1;
+}
@@ -0,0 +1,270 @@
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "Codec.h"
+#include "Compression.h"
+#include "ImageHeader.h"
+#include "MappedFile.h"
+#include "Pipeline.h"
+#include "Qoi.h"
+#include "Resample.h"
+#include "TileStore.h"
+#include <memory>
+#include <new>
+
+// Headless converter between the raw formats the viewer understands, e.g.
+// ikt-convert in.bin --size 640x480 --in-format BGR --out-format RGBA out.txt
+
+static void usage() {
+    fprintf(stderr, "usage: ikt-convert <input> --size WxH --in-format FORMAT --out-format FORMAT [--resize WxH [--filter FILTER]] <output>\n");
+    fprintf(stderr, "  .bin files hold raw bytes, .txt files hold bytes as '0' and '1' characters.\n");
+    fprintf(stderr, "  .ikt files hold raw bytes behind a header with the size and format, which don't need to be given.\n");
+    fprintf(stderr, "  .iktz files are compressed .ikt files.\n");
+    fprintf(stderr, "  .qoi files are lossless RGB images, they take no --in-format or --out-format.\n");
+    fprintf(stderr, "  --resize scales the image with a box, bilinear or lanczos --filter, lanczos by default.\n");
+    fprintf(stderr, "  formats:");
+    for (int i = 0; i < static_cast<int>(ColorFormat::Invalid); i++)
+        fprintf(stderr, " %s", get_colorFormatName(static_cast<ColorFormat>(i)));
+    fprintf(stderr, "\n");
+}
+// Sizes image for size pixels, returns false with a message if there isn't the memory for them.
+static bool allocateImage(std::vector<Pixel>& image, size_t size) {
+    try {
+        if (size > image.max_size()) throw std::bad_alloc();
+        image.resize(size);
+    }
+    catch (const std::bad_alloc&) {
+        fprintf(stderr, "ikt-convert: not enough memory for %zu pixels\n", size);
+        return false;
+    }
+    return true;
+}
+// Reads WxH, both positive and with every pixel of the image countable in bytes.
+static bool parseSize(const char* text, int64_t& width, int64_t& height) {
+    if (sscanf(text, "%" SCNd64 "x%" SCNd64, &width, &height) != 2 || width <= 0 || height <= 0) return false;
+    return static_cast<uint64_t>(width) <= UINT64_MAX / sizeof(Pixel) / static_cast<uint64_t>(height);
+}
+static int convert(int argc, char** argv)
+{
+    const char* input = NULL;
+    const char* output = NULL;
+    int64_t width = 0, height = 0;
+    int64_t resizeWidth = 0, resizeHeight = 0;
+    ColorFormat inFormat = ColorFormat::Invalid, outFormat = ColorFormat::Invalid;
+    ResampleFilter filter = ResampleFilter::lanczos;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+            if (!parseSize(argv[++i], width, height)) {
+                fprintf(stderr, "ikt-convert: invalid size '%s'\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--resize") == 0 && i + 1 < argc) {
+            if (!parseSize(argv[++i], resizeWidth, resizeHeight)) {
+                fprintf(stderr, "ikt-convert: invalid size '%s'\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            if (!resampleFilterFromName(argv[++i], filter)) {
+                fprintf(stderr, "ikt-convert: unknown filter '%s'\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--in-format") == 0 && i + 1 < argc) inFormat = parseColorFormat(argv[++i]);
+        else if (strcmp(argv[i], "--out-format") == 0 && i + 1 < argc) outFormat = parseColorFormat(argv[++i]);
+        else if (argv[i][0] == '-' && argv[i][1] == '-') {
+            usage();
+            return 1;
+        }
+        else if (input == NULL) input = argv[i];
+        else if (output == NULL) output = argv[i];
+        else {
+            usage();
+            return 1;
+        }
+    }
+    if (input == NULL || output == NULL) {
+        usage();
+        return 1;
+    }
+    ImageFormat inType = get_imageFormat(input), outType = get_imageFormat(output);
+    if (inType == ImageFormat::invalid || outType == ImageFormat::invalid) {
+        fprintf(stderr, "ikt-convert: only .bin, .ikt, .iktz, .qoi and .txt files are supported\n");
+        return 1;
+    }
+    // QOI stores RGB
+    if (outType == ImageFormat::qoi) outFormat = ColorFormat::RGB;
+    if (outFormat == ColorFormat::Invalid) {
+        usage();
+        return 1;
+    }
+    // .bin, .ikt and .iktz files are decoded straight from a mapping, .txt and .qoi files and .bin files that can't be mapped are streamed
+    MappedFile mapping;
+    InputFile stream;
+    bool mapped = inType != ImageFormat::txt && inType != ImageFormat::qoi && mapping.open(input);
+    if (!mapped && ((inType != ImageFormat::bin && inType != ImageFormat::txt && inType != ImageFormat::qoi) || !stream.open(input))) {
+        fprintf(stderr, "ikt-convert: cannot read '%s'\n", input);
+        return 1;
+    }
+    // The header of an .ikt, .iktz or .qoi file stands in for --size and --in-format, they have to agree with it if given
+    ImageHeader header;
+    CompressedHeader compressed;
+    QoiHeader qoi;
+    bool described = inType == ImageFormat::ikt || inType == ImageFormat::iktz || inType == ImageFormat::qoi;
+    if (described) {
+        HeaderStatus status;
+        uint64_t fileWidth, fileHeight;
+        ColorFormat fileFormat;
+        if (inType == ImageFormat::ikt) {
+            status = readImageHeader(mapping.data(), mapping.size(), header);
+            fileWidth = header.width;
+            fileHeight = header.height;
+            fileFormat = header.cf;
+        }
+        else if (inType == ImageFormat::iktz) {
+            status = readCompressedHeader(mapping.data(), mapping.size(), compressed);
+            fileWidth = compressed.width;
+            fileHeight = compressed.height;
+            fileFormat = compressed.cf;
+        }
+        else {
+            // The rest of the file is streamed from after the header
+            uint8_t data[qoiHeaderSize];
+            size_t count;
+            status = stream.read(data, sizeof(data), count) ? readQoiHeader(data, stream.size(), qoi) : HeaderStatus::invalid;
+            fileWidth = qoi.width;
+            fileHeight = qoi.height;
+            fileFormat = ColorFormat::RGB;
+        }
+        if (status != HeaderStatus::ok) {
+            fprintf(stderr, "ikt-convert: '%s' %s\n", input, status == HeaderStatus::newerVersion ? "was written by a newer version" :
+                status == HeaderStatus::truncated ? "is shorter than its header says" : "has an invalid header");
+            return 1;
+        }
+        if ((width != 0 && (static_cast<uint64_t>(width) != fileWidth || static_cast<uint64_t>(height) != fileHeight)) ||
+            (inFormat != ColorFormat::Invalid && inFormat != fileFormat)) {
+            fprintf(stderr, "ikt-convert: '%s' is %" PRIu64 "x%" PRIu64 " %s according to its header\n", input, fileWidth, fileHeight, get_colorFormatName(fileFormat));
+            return 1;
+        }
+        width = fileWidth;
+        height = fileHeight;
+        inFormat = fileFormat;
+    }
+    if (width == 0 || height == 0 || inFormat == ColorFormat::Invalid) {
+        usage();
+        return 1;
+    }
+    if (resizeWidth == 0) {
+        resizeWidth = width;
+        resizeHeight = height;
+    }
+    if (outType == ImageFormat::qoi && (resizeWidth > UINT32_MAX || resizeHeight > UINT32_MAX)) {
+        fprintf(stderr, "ikt-convert: QOI images are at most %" PRIu32 " pixels wide and high\n", UINT32_MAX);
+        return 1;
+    }
+    if (outType == ImageFormat::iktz && static_cast<uint64_t>(resizeWidth) > get_compressedMaxWidth(outFormat)) {
+        fprintf(stderr, "ikt-convert: .iktz images in %s are at most %" PRIu64 " pixels wide\n", get_colorFormatName(outFormat), get_compressedMaxWidth(outFormat));
+        return 1;
+    }
+    uint64_t rawSize = mapped ? mapping.size() : stream.size();
+    if (inType == ImageFormat::txt) {
+        if (rawSize % 8 != 0) {
+            fprintf(stderr, "ikt-convert: .txt files need to be a multiple of 8 bytes\n");
+            return 1;
+        }
+        rawSize /= 8;
+    }
+    size_t imageSize = width * height;
+    if (!described && rawSize != imageSize * get_pixelSize(inFormat))
+        fprintf(stderr, "ikt-convert: warning: '%s' doesn't match the size and color model, overflow repeats the image\n", input);
+    // .ikt files and .bin files holding the whole image are converted a chunk at a time straight from the mapping,
+    // so they don't have to fit in memory. Resizing needs all of the image, and a file converted in place is gone once
+    // the output is opened, whatever path it was given by.
+    bool resized = resizeWidth != width || resizeHeight != height;
+    bool streamed = !resized && !isSameFile(input, output);
+    std::unique_ptr<TileStore> store;
+    std::vector<Pixel> image;
+    if (streamed && inType == ImageFormat::ikt)
+        store.reset(new TileStore(mapping.data() + header.dataOffset, header.stride, inFormat, width, height, 0));
+    else if (streamed && mapped && inType == ImageFormat::bin && rawSize >= imageSize * get_pixelSize(inFormat))
+        store.reset(new TileStore(mapping.data(), width * get_pixelSize(inFormat), inFormat, width, height, 0));
+    else if (!allocateImage(image, imageSize)) return 1;
+    if (!store) {
+        if (inType == ImageFormat::ikt) {
+            decodeRows(reinterpret_cast<const char*>(mapping.data() + header.dataOffset), header.stride, inFormat, image.data(), width, height);
+            mapping.close();
+        }
+        else if (inType == ImageFormat::iktz) {
+            bool ok = decodeCompressed(mapping.data(), mapping.size(), compressed, image.data());
+            mapping.close();
+            if (!ok) {
+                fprintf(stderr, "ikt-convert: '%s' is corrupt\n", input);
+                return 1;
+            }
+        }
+        else if (mapped) {
+            decodeImage(reinterpret_cast<const char*>(mapping.data()), mapping.size(), inFormat, image.data(), imageSize);
+            mapping.close();
+        }
+        else {
+            TextError error;
+            StreamStatus status = decodeFile(stream, inType, inFormat, image.data(), imageSize, error);
+            stream.close();
+            if (status == StreamStatus::invalidText) {
+                fprintf(stderr, "ikt-convert: '%s' contains %zu characters other than '0' and '1', the first one at offset %zu\n", input, error.count, error.firstOffset);
+                return 1;
+            }
+            if (status == StreamStatus::truncated) {
+                fprintf(stderr, "ikt-convert: '%s' ends before the image does\n", input);
+                return 1;
+            }
+            if (status != StreamStatus::ok) {
+                fprintf(stderr, "ikt-convert: cannot read '%s'\n", input);
+                return 1;
+            }
+        }
+    }
+    if (resized) {
+        std::vector<Pixel> scaled;
+        if (!allocateImage(scaled, resizeWidth * resizeHeight)) return 1;
+        resampleImage(image.data(), width, height, scaled.data(), resizeWidth, resizeHeight, filter);
+        image.swap(scaled);
+        width = resizeWidth;
+        height = resizeHeight;
+        imageSize = width * height;
+    }
+    PixelSource source = store ? store->get_source() : get_pixelSource(image.data());
+    OutputFile out;
+    bool ok = out.open(output);
+    if (outType == ImageFormat::iktz) ok = ok && encodeCompressed(out, outFormat, source, width, height);
+    else if (outType == ImageFormat::qoi) {
+        QoiHeader header;
+        header.width = static_cast<uint32_t>(width);
+        header.height = static_cast<uint32_t>(height);
+        uint8_t data[qoiHeaderSize];
+        writeQoiHeader(header, data);
+        ok = ok && out.write(data, sizeof(data)) && encodeFile(out, outType, outFormat, source, imageSize);
+    }
+    else {
+        ok = ok && (outType != ImageFormat::ikt || writeImageHeader(out, makeImageHeader(outFormat, width, height)));
+        ok = ok && encodeFile(out, outType, outFormat, source, imageSize);
+    }
+    if (!(out.close() && ok)) {
+        fprintf(stderr, "ikt-convert: cannot write '%s'\n", output);
+        return 1;
+    }
+    return 0;
+}
+// Allocations made by the codec on the thread pool throw as well, they end the conversion the same way.
+int main(int argc, char** argv)
+{
+    try {
+        return convert(argc, argv);
+    }
+    catch (const std::bad_alloc&) {
+        fprintf(stderr, "ikt-convert: not enough memory\n");
+        return 1;
+    }
+}
@@ -1,43 +1,72 @@
 #ifndef UNICODE
 #define UNICODE
 #endif 
+// The standard headers the codec headers pull in clash with the min and max macros
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
 
 #include <cstdint>
 #include <windows.h>
 #include <wincodec.h>
+#include <cmath>
 #include <cstdio>
 #include "resource.h"
+#include "Codec.h"
+#include "Compression.h"
+#include "ImageHeader.h"
+#include "ImageLoader.h"
+#include "MappedFile.h"
+#include "Pipeline.h"
+#include "Pyramid.h"
+#include "Qoi.h"
+#include "TileStore.h"
+#include "Viewport.h"
+#include <algorithm>
+#include <climits>
+#include <memory>
+#include <new>
+#include <string>
 #pragma comment(lib, "Windowscodecs.lib")
 
-
-enum class ImageFormat {
-    invalid,
-    txt,
-    bin,
-};
-
-enum class ColorFormat {
-    RGBA, RGB, ARGB, BGRA, BGR, ABGR, BAGR,
-    GrayScale,
-    CMY, CMYK, HSL, HSLA, HSV, HSVA,
-    Python, Invalid,
-};
-
-typedef RGBQUAD(*ColorFormatDecoder)(const char*& data);
-typedef void(*ColorFormatEncoder)(char*& data, RGBQUAD color);
+static_assert(sizeof(Pixel) == sizeof(RGBQUAD), "Pixel must match the RGBQUAD layout of the DIB section");
 
 static constexpr DWORD mydwstyle = WS_OVERLAPPEDWINDOW;
 
 static HWND hwnd;
 static int64_t width = 0, height = 0;
-static int64_t oldwidth = 0, oldheight = 0;
-static RGBQUAD* imagedata = NULL;
+static Pixel* imagedata = NULL;
 static HBITMAP imagebitmap = NULL;
+// Images too large for memory stay in their mapped file instead of imagedata, see openStore
+static std::unique_ptr<MappedFile> imagemapping;
+static std::unique_ptr<TileStore> imagestore;
+static std::wstring storepath;
+static constexpr size_t storebudget = 256 << 20;
+// Decodes imagedata in the background, the pixels from its start that are done so far are shown, see showDecoded
+static std::unique_ptr<ImageLoader> loader;
+static uint64_t decodedpixels = UINT64_MAX;
+// Why the decoding failed, written by the loader before it finishes
+static wchar_t loaderror[256];
+static constexpr UINT WM_DECODED = WM_APP;
+// Halved copies of the image, built on the first paint after it changes
+static ImagePyramid pyramid;
+// The view scaled in tiles, painting only copies them
+static TileCache tilecache(pyramid, 128 << 20);
+// Fits the image in the window until it's zoomed or panned
+static View view;
+static bool fitview = true;
+static bool panning = false;
+static int panx = 0, pany = 0;
+static constexpr double maxzoom = 64.0;
 static bool menuredraw = false;
 static ColorFormat colorformat = ColorFormat::Invalid;
 static int windowwidth = 300, windowheight = 0;
 
 static bool endsWith(const wchar_t* str, const wchar_t* suffix);
+static bool fitsDibSection(uint64_t width, uint64_t height);
+static void releaseView();
+static void fitWindowToImage();
+static void startDecoding(HBITMAP bitmap, Pixel* pixels, ColorFormat cf, int64_t imageWidth, int64_t imageHeight, const ImageLoader::Job& job);
 static LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
 static INT_PTR CALLBACK ColorQueryDialogProc(HWND hwndDlg, UINT message, WPARAM wParam, LPARAM lParam);
 
@@ -110,6 +139,41 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR pCmdLine
     return 0;
 }
 
+// Decodes a file WIC reads into pixels in bands of rows, on the loader thread. Tells progress about every band.
+static bool decodewicfile(const wchar_t* path, Pixel* pixels, UINT imageWidth, UINT imageHeight, const DecodeProgress& progress) {
+    // The loader thread has COM to itself, nothing from the window thread is used here
+    if (FAILED(CoInitializeEx(NULL, COINIT_MULTITHREADED))) {
+        swprintf_s(loaderror, L"Failed to initialize WIC.");
+        return false;
+    }
+    IWICImagingFactory* pFactory = NULL;
+    IWICBitmapDecoder* pDecoder = NULL;
+    IWICBitmapFrameDecode* pFrameDecode = NULL;
+    IWICFormatConverter* pConverter = NULL;
+    bool ok = false;
+    MULTI_QI mqi{ &IID_IWICImagingFactory, NULL, NULL };
+    if (SUCCEEDED(CoCreateInstanceEx(CLSID_WICImagingFactory, NULL, CLSCTX_INPROC_SERVER, NULL, 1, &mqi))) pFactory = reinterpret_cast<IWICImagingFactory*>(mqi.pItf);
+    if (pFactory != NULL && SUCCEEDED(pFactory->CreateDecoderFromFilename(path, NULL, GENERIC_READ, WICDecodeMetadataCacheOnDemand, &pDecoder)) &&
+        SUCCEEDED(pDecoder->GetFrame(0, &pFrameDecode)) && SUCCEEDED(pFactory->CreateFormatConverter(&pConverter)) &&
+        SUCCEEDED(pConverter->Initialize(pFrameDecode, GUID_WICPixelFormat32bppBGRA, WICBitmapDitherTypeNone, NULL, 0.0f, WICBitmapPaletteTypeMedianCut))) {
+        ok = true;
+        UINT bandRows = static_cast<UINT>(std::max<size_t>(progressBand / imageWidth, 1));
+        for (UINT y = 0; ok && y < imageHeight; y += bandRows) {
+            WICRect rect = { 0, static_cast<INT>(y), static_cast<INT>(imageWidth), static_cast<INT>(std::min(bandRows, imageHeight - y)) };
+            ok = SUCCEEDED(pConverter->CopyPixels(&rect, imageWidth * sizeof(RGBQUAD), rect.Height * imageWidth * sizeof(RGBQUAD), reinterpret_cast<BYTE*>(pixels + static_cast<size_t>(y) * imageWidth)));
+            if (ok && !progress(static_cast<uint64_t>(y + rect.Height) * imageWidth)) break;
+        }
+        if (!ok) swprintf_s(loaderror, L"Failed to copy pixels.");
+    }
+    else swprintf_s(loaderror, L"WIC error.");
+    if (pConverter != NULL) pConverter->Release();
+    if (pFrameDecode != NULL) pFrameDecode->Release();
+    if (pDecoder != NULL) pDecoder->Release();
+    if (pFactory != NULL) pFactory->Release();
+    CoUninitialize();
+    return ok;
+}
+// Only reads the size of the image, the pixels are decoded in the background by decodewicfile.
 static bool openwicfile(const wchar_t* path) {
     IWICImagingFactory* pFactory;
     {
@@ -127,62 +191,37 @@ static bool openwicfile(const wchar_t* path) {
         return false;
     }
     IWICBitmapFrameDecode* pFrameDecode;
-    if (FAILED(pDecoder->GetFrame(0, &pFrameDecode))) {
-        MessageBoxExW(NULL, L"WIC error.", L"Error", MB_OK | MB_ICONERROR, NULL);
-        return false;
-    }
-    {
-        UINT iwidth, iheight;
-        if (FAILED(pFrameDecode->GetSize(&iwidth, &iheight))) {
-            MessageBoxExW(NULL, L"WIC error.", L"Error", MB_OK | MB_ICONERROR, NULL);
-            return false;
-        }
-        width = iwidth;
-        height = iheight;
-    }
-    IWICFormatConverter* pConverter;
-    if (FAILED(pFactory->CreateFormatConverter(&pConverter))) {
+    UINT iwidth, iheight;
+    bool ok = SUCCEEDED(pDecoder->GetFrame(0, &pFrameDecode));
+    if (ok) {
+        ok = SUCCEEDED(pFrameDecode->GetSize(&iwidth, &iheight));
         pFrameDecode->Release();
-        pDecoder->Release();
-        pFactory->Release();
-        return false; // Could not create format converter
     }
-    if (FAILED(pConverter->Initialize(pFrameDecode, GUID_WICPixelFormat32bppBGRA, WICBitmapDitherTypeNone, NULL, 0.0f, WICBitmapPaletteTypeMedianCut))) {
-        pConverter->Release();
-        pFrameDecode->Release();
-        pDecoder->Release();
-        pFactory->Release();
-        return false; // Could not convert image format
+    pDecoder->Release();
+    pFactory->Release();
+    if (!ok) {
+        MessageBoxExW(NULL, L"WIC error.", L"Error", MB_OK | MB_ICONERROR, NULL);
+        return false;
     }
-    {
+    HBITMAP bitmap = NULL;
+    Pixel* pixels = NULL;
+    if (fitsDibSection(iwidth, iheight)) {
         BITMAPINFO bitmapinfo;
         ZeroMemory(&bitmapinfo, sizeof(BITMAPINFO));
         bitmapinfo.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
-        bitmapinfo.bmiHeader.biWidth = width;
-        bitmapinfo.bmiHeader.biHeight = -height;
+        bitmapinfo.bmiHeader.biWidth = iwidth;
+        bitmapinfo.bmiHeader.biHeight = -static_cast<LONG>(iheight);
         bitmapinfo.bmiHeader.biPlanes = 1;
         bitmapinfo.bmiHeader.biBitCount = 32;
         bitmapinfo.bmiHeader.biCompression = BI_RGB;
-        imagebitmap = CreateDIBSection(NULL, &bitmapinfo, DIB_RGB_COLORS, reinterpret_cast<void**>(&imagedata), NULL, NULL);
+        bitmap = CreateDIBSection(NULL, &bitmapinfo, DIB_RGB_COLORS, reinterpret_cast<void**>(&pixels), NULL, NULL);
     }
-    if (FAILED(pConverter->CopyPixels(NULL, width * sizeof(RGBQUAD), width * height * sizeof(RGBQUAD), reinterpret_cast<BYTE*>(imagedata)))) {
-        MessageBoxExW(NULL, L"Failed to copy pixels.", L"Error", MB_OK | MB_ICONERROR, NULL);
+    if (bitmap == NULL) {
+        MessageBoxExW(NULL, L"Not enough memory for an image this size.", L"Error", MB_OK | MB_ICONERROR, NULL);
         return false;
     }
-    // Adjusts the window to match the size of the image and redraws it.
-    {
-        RECT rect;
-        GetWindowRect(hwnd, &rect);
-        rect.right = rect.left + width;
-        rect.bottom = rect.top + height;
-        AdjustWindowRect(&rect, mydwstyle, TRUE);
-        MoveWindow(hwnd, rect.left, rect.top, rect.right - rect.left, rect.bottom - rect.top, FALSE);
-        InvalidateRect(hwnd, NULL, TRUE);
-        menuredraw = true;
-    }
-    pDecoder->Release();
-    pFrameDecode->Release();
-    pFactory->Release();
+    std::wstring file(path);
+    startDecoding(bitmap, pixels, colorformat, iwidth, iheight, [=](const DecodeProgress& progress) { return decodewicfile(file.c_str(), pixels, iwidth, iheight, progress); });
     return true;
 }
 
@@ -249,17 +288,9 @@ static bool savewicfile(const wchar_t* path) {
         pFactory->Release();
         return false;
     }
+    // Packed as blue, green, red like the raw BGR format, so it shares its encoder and its bands on the thread pool
     BYTE* data = new BYTE[width * height * 3];
-    {
-        size_t loopCount = width * height;
-        BYTE* current = data;
-        for (size_t i = 0; i < loopCount; i++) {
-            RGBQUAD rgb = imagedata[i];
-            *(current++) = rgb.rgbBlue;
-            *(current++) = rgb.rgbGreen;
-            *(current++) = rgb.rgbRed;
-        }
-    }
+    encodeImage(imagedata, width * height, ColorFormat::BGR, reinterpret_cast<char*>(data));
     pFrameEncode->SetSize(width, height);
     {
         GUID guid = GUID_WICPixelFormat24bppRGB;
@@ -309,60 +340,41 @@ static bool endsWith(const wchar_t* str, const wchar_t* suffix)
         return false;
     return wcsncmp(str + lenstr - lensuffix, suffix, lensuffix) == 0;
 }
-static char readtxtbyte(char*& file) {
-    char byte = 0;
-    for (int i = 0; i < 8; ++i) {
-        char ch = *(file++);
-        if (ch != '0' && ch != '1') {
-            MessageBoxExW(NULL, L".txt files can only contain '0' and '1' characters. ", L"Error", MB_OK | MB_ICONERROR, NULL);
-            return (char)0b11111111;
-        }
-        byte |= (ch == '1' ? 1 : 0) << (7 - i);
-    }
-    return byte;
-}
-static void writetxtbyte(char*& file, char byte) {
-    for (int i = 0; i < 8; ++i)
-        *(file++) = (byte & (1 << (7 - i))) ? '1' : '0';
-}
-static bool decidecolorformat(const wchar_t* buffer) {
-    if (_wcsicmp(buffer, L"RGBA") == 0 || *buffer == L'\0') colorformat = ColorFormat::RGBA;
-    else if (_wcsicmp(buffer, L"RGB") == 0) colorformat = ColorFormat::RGB;
-    else if (_wcsicmp(buffer, L"ARGB") == 0) colorformat = ColorFormat::ARGB;
-    else if (_wcsicmp(buffer, L"BGRA") == 0) colorformat = ColorFormat::BGRA;
-    else if (_wcsicmp(buffer, L"BGR") == 0) colorformat = ColorFormat::BGR;
-    else if (_wcsicmp(buffer, L"ABGR") == 0) colorformat = ColorFormat::ABGR;
-    else if (_wcsicmp(buffer, L"BAGR") == 0) colorformat = ColorFormat::BAGR;
-    else if (_wcsicmp(buffer, L"GS") == 0 || _wcsicmp(buffer, L"GrayScale") == 0 || _wcsicmp(buffer, L"GreyScale") == 0 || _wcsicmp(buffer, L"Gray") == 0 || _wcsicmp(buffer, L"Grey") == 0) colorformat = ColorFormat::GrayScale;
-    else if (_wcsicmp(buffer, L"CMY") == 0) colorformat = ColorFormat::CMY;
-    else if (_wcsicmp(buffer, L"CMYK") == 0) colorformat = ColorFormat::CMYK;
-    else if (_wcsicmp(buffer, L"HSL") == 0) colorformat = ColorFormat::HSL;
-    else if (_wcsicmp(buffer, L"HSLA") == 0) colorformat = ColorFormat::HSLA;
-    else if (_wcsicmp(buffer, L"HSV") == 0) colorformat = ColorFormat::HSV;
-    else if (_wcsicmp(buffer, L"HSVA") == 0) colorformat = ColorFormat::HSVA;
-    else if (_wcsicmp(buffer, L"=(") == 0) colorformat = ColorFormat::Python;
-    else return false;
+static bool decidecolorformat(const wchar_t* buffer, ColorFormat& format) {
+    ColorFormat cf = parseColorFormat(buffer);
+    if (cf == ColorFormat::Invalid) return false;
+    format = cf;
     return true;
 }
+// Sizes are positive and every pixel of the image countable in bytes, as ikt-convert checks its --size.
+static bool validImageSize(int64_t width, int64_t height) {
+    return width > 0 && height > 0 && static_cast<uint64_t>(width) <= UINT64_MAX / sizeof(Pixel) / static_cast<uint64_t>(height);
+}
+// What QueryDialogProc asks for, its lParam. Kept apart from the shown image until the new one replaces it.
+struct ImageQuery {
+    int64_t width, height;
+    ColorFormat cf;
+};
 static INT_PTR CALLBACK QueryDialogProc(HWND hwndDlg, UINT message, WPARAM wParam, LPARAM lParam) {
     switch (message) {
     case WM_INITDIALOG:
+        SetWindowLongPtrW(hwndDlg, DWLP_USER, lParam);
         return TRUE;
     case WM_COMMAND:
         if (LOWORD(wParam) == IDOK) {
-            oldwidth = width;
-            oldheight = height;
+            ImageQuery* query = reinterpret_cast<ImageQuery*>(GetWindowLongPtrW(hwndDlg, DWLP_USER));
+            ImageQuery answer = *query;
             wchar_t buffer1[256], buffer2[256], buffer3[256];
             GetDlgItemTextW(hwndDlg, IDC_EDIT_INT1, buffer1, 256);
             GetDlgItemTextW(hwndDlg, IDC_EDIT_INT2, buffer2, 256);
             GetDlgItemTextW(hwndDlg, IDC_EDIT_INT3, buffer3, 256);
-            if (swscanf_s(buffer1, L"%lld", &width) == 1 && swscanf_s(buffer2, L"%lld", &height) == 1 && decidecolorformat(buffer3)) {
+            if (swscanf_s(buffer1, L"%lld", &answer.width) == 1 && swscanf_s(buffer2, L"%lld", &answer.height) == 1 && decidecolorformat(buffer3, answer.cf) &&
+                validImageSize(answer.width, answer.height)) {
+                *query = answer;
                 EndDialog(hwndDlg, IDOK);
                 return TRUE;
             }
             MessageBoxW(hwndDlg, L"Invalid input", L"Error", MB_OK | MB_ICONERROR);
-            width = oldwidth;
-            height = oldheight;
         }
         break;
     }
@@ -376,7 +388,7 @@ static INT_PTR CALLBACK ColorQueryDialogProc(HWND hwndDlg, UINT message, WPARAM
         if (LOWORD(wParam) == IDOK) {
             wchar_t buffer[256];
             GetDlgItemTextW(hwndDlg, IDC_EDIT_CM, buffer, 256);
-            if (decidecolorformat(buffer)) {
+            if (decidecolorformat(buffer, colorformat)) {
                 EndDialog(hwndDlg, IDOK);
                 return TRUE;
             }
@@ -385,442 +397,231 @@ static INT_PTR CALLBACK ColorQueryDialogProc(HWND hwndDlg, UINT message, WPARAM
     }
     return FALSE;
 }
-static size_t get_pixelSize(ColorFormat cf) {
-    switch (cf)
-    {
-    case ColorFormat::Invalid:
-    default:
-    case ColorFormat::RGBA:
-    case ColorFormat::ARGB:
-    case ColorFormat::BGRA:
-    case ColorFormat::ABGR:
-    case ColorFormat::BAGR:
-    case ColorFormat::CMYK:
-    case ColorFormat::HSLA:
-    case ColorFormat::HSVA:
-        return 4;
-    case ColorFormat::RGB:
-    case ColorFormat::BGR:
-    case ColorFormat::CMY:
-    case ColorFormat::HSL:
-    case ColorFormat::HSV:
-        return 3;
-    case ColorFormat::GrayScale:
-        return 1;
-    case ColorFormat::Python:
-        return 4 * sizeof(long double);
-    }
-}
-static void CALLBACK readfileexCallback(DWORD dwErrorCode, DWORD dwNumberOfBytesTransfered, LPOVERLAPPED lpOverlapped) {
-    CloseHandle(lpOverlapped->hEvent);
-}
-static void CALLBACK writefileexCallback(DWORD dwErrorCode, DWORD dwNumberOfBytesTransfered, LPOVERLAPPED lpOverlapped) {
-    CloseHandle(lpOverlapped->hEvent);
-}
-static void readtxtfile(HANDLE file, size_t fileSize) {
-    // The entire file is read into data before it can be parsed
-    char* data = new char[fileSize * 32];
-    for (size_t i = 0; i < fileSize * 32; i++) data[i] = '0';
-    {
-        OVERLAPPED overlapped;
-        ZeroMemory(&overlapped, sizeof(OVERLAPPED));
-        overlapped.hEvent = CreateEventExW(NULL, NULL, CREATE_EVENT_MANUAL_RESET, EVENT_MODIFY_STATE | SYNCHRONIZE);
-        (void)ReadFileEx(file, data, fileSize * 32, &overlapped, readfileexCallback);
-        (void)WaitForSingleObjectEx(overlapped.hEvent, 1000, TRUE);
-        CloseHandle(file);
-    }
-    // Reads only the data found in the file, the rest is filled with black. data is deleted as it is no longer needed.
-    {
-        size_t imageSize = width * height;
-        size_t loopCount = min(fileSize, imageSize);
-        char* current = data;
-        for (size_t i = 0; i < loopCount; i++) {
-            RGBQUAD rgb{};
-            rgb.rgbRed = readtxtbyte(current);
-            rgb.rgbGreen = readtxtbyte(current);
-            rgb.rgbBlue = readtxtbyte(current);
-            rgb.rgbReserved = NULL;
-            (void)readtxtbyte(current);
-            imagedata[i] = rgb;
-        }
-        for (size_t i = loopCount; i < imageSize; i++) {
-            imagedata[i] = imagedata[i % loopCount];
-        }
-        delete[] data;
-    }
+// Adjusts the window to match the size of the image and redraws it.
+static void fitWindowToImage() {
+    RECT rect;
+    GetWindowRect(hwnd, &rect);
+    rect.right = rect.left + static_cast<LONG>(width);
+    rect.bottom = rect.top + static_cast<LONG>(height);
+    AdjustWindowRect(&rect, mydwstyle, TRUE);
+    MoveWindow(hwnd, rect.left, rect.top, rect.right - rect.left, rect.bottom - rect.top, FALSE);
+    InvalidateRect(hwnd, NULL, TRUE);
+    menuredraw = true;
+}
+// CreateDIBSection takes the size as LONGs, and the pixels have to be addressable before they can be allocated.
+static bool fitsDibSection(uint64_t width, uint64_t height) {
+    return width != 0 && height != 0 && width <= LONG_MAX && height <= LONG_MAX && width <= SIZE_MAX / sizeof(Pixel) / height;
+}
+// Half of the free memory is left for everything else.
+static bool fitsInMemory(uint64_t bytes) {
+    MEMORYSTATUSEX status;
+    status.dwLength = sizeof(status);
+    return !GlobalMemoryStatusEx(&status) || bytes <= status.ullAvailPhys / 2;
+}
+// Shows an image that is too large for memory from its file, which has to hold all of it, the rows from offset on
+// stride bytes apart. The view decodes the tiles it needs through a TileStore. Returns false if the file can't be mapped.
+static bool openStore(const wchar_t* path, uint64_t offset, size_t stride, ColorFormat cf, int64_t imageWidth, int64_t imageHeight) {
+    std::unique_ptr<MappedFile> mapping(new MappedFile());
+    if (!mapping->open(path)) return false;
+    std::unique_ptr<TileStore> store(new TileStore(mapping->data() + offset, stride, cf, imageWidth, imageHeight, storebudget));
+    // The view goes first, it reads from the store, which reads from the mapping. A decode still running writes into
+    // the old bitmap, so it stops before that goes
+    loader.reset();
+    decodedpixels = UINT64_MAX;
+    if (imagebitmap != NULL) DeleteObject(imagebitmap);
+    imagebitmap = NULL;
+    imagedata = NULL;
+    releaseView();
+    imagestore = std::move(store);
+    imagemapping = std::move(mapping);
+    storepath = path;
+    width = imageWidth;
+    height = imageHeight;
+    colorformat = cf;
+    fitWindowToImage();
+    return true;
 }
-static void readbinfile(HANDLE file, size_t fileSize) {
-    // The entire file is read into data before it can be parsed
-    char* data = new char[fileSize * 4];
-    for (size_t i = 0; i < fileSize * 4; i++) data[i] = '0';
-    {
-        OVERLAPPED overlapped;
-        ZeroMemory(&overlapped, sizeof(OVERLAPPED));
-        overlapped.hEvent = CreateEventExW(NULL, NULL, CREATE_EVENT_MANUAL_RESET, EVENT_MODIFY_STATE | SYNCHRONIZE);
-        (void)ReadFileEx(file, data, fileSize * 4, &overlapped, readfileexCallback);
-        (void)WaitForSingleObjectEx(overlapped.hEvent, 1000, TRUE);
-        CloseHandle(file);
-    }
-    // Reads only the data found in the file, the rest is filled with black. data is deleted as it is no longer needed.
-    {
-        size_t imageSize = width * height;
-        size_t loopCount = min(fileSize, imageSize);
-        char* current = data;
-        for (size_t i = 0; i < loopCount; i++) {
-            RGBQUAD rgb{};
-            rgb.rgbRed = *(current++);
-            rgb.rgbGreen = *(current++);
-            rgb.rgbBlue = *(current++);
-            rgb.rgbReserved = NULL;
-            current++;
-            imagedata[i] = rgb;
+// Replaces the image with bitmap, whose pixels job decodes in the background. The window shows it black at first and
+// fills in the rows as they come. The size and format only change here and in openStore, together with the pixels.
+static void startDecoding(HBITMAP bitmap, Pixel* pixels, ColorFormat cf, int64_t imageWidth, int64_t imageHeight, const ImageLoader::Job& job) {
+    // A decode still running writes into the old bitmap, so it stops before that goes
+    loader.reset();
+    if (imagebitmap != NULL) DeleteObject(imagebitmap);
+    releaseView();
+    imagestore.reset();
+    imagemapping.reset();
+    imagebitmap = bitmap;
+    imagedata = pixels;
+    width = imageWidth;
+    height = imageHeight;
+    colorformat = cf;
+    decodedpixels = 0;
+    // The codec's buffers are allocated on the thread pool, running out of memory there fails the decode like a broken file
+    ImageLoader::Job guarded = [job](const DecodeProgress& progress) {
+        try {
+            return job(progress);
         }
-        for (size_t i = loopCount; i < imageSize; i++) {
-            imagedata[i] = imagedata[i % loopCount];
+        catch (const std::bad_alloc&) {
+            swprintf_s(loaderror, L"Not enough memory to decode the image.");
+            return false;
         }
-        delete[] data;
-    }
-}
-static uint8_t hueToRgb(uint8_t p, uint8_t q, uint8_t t) {
-    if (t < 42) return p + (t * (q - p)) / 42;
-    if (t < 128) return q;
-    if (t < 170) return p + ((170 - t) * (q - p)) / 42;
-    return p;
-}
-static uint8_t pythonHueToRgb(long double p, long double q, long double t) {
-    if (t < 0.0L) t += 360.0L;
-    if (t > 360.0L) t -= 360.0L;
-    if (t < 60.0L) return (p + ((q - p) * t) / 60.0L) * 255;
-    if (t < 180.0L) return q * 255;
-    if (t < 240.0L) return (p + ((q - p) * (240.0L - t)) / 60.0L) * 255;
-    return p * 255;
-}
-static RGBQUAD RGBAdecoder(const char*& data) {
-    RGBQUAD rgb{};
-    rgb.rgbRed  = *(data++);
-    rgb.rgbGreen = *(data++);
-    rgb.rgbBlue = *(data++);
-    data++;
-    return rgb;
-}
-static RGBQUAD RGBdecoder(const char*& data) {
-    RGBQUAD rgb{};
-    rgb.rgbRed = *(data++);
-    rgb.rgbGreen = *(data++);
-    rgb.rgbBlue = *(data++);
-    return rgb;
-}
-static RGBQUAD ARGBdecoder(const char*& data) {
-    RGBQUAD rgb{};
-    data++;
-    rgb.rgbRed = *(data++);
-    rgb.rgbGreen = *(data++);
-    rgb.rgbBlue = *(data++);
-    return rgb;
-}
-static RGBQUAD BGRAdecoder(const char*& data) {
-    RGBQUAD rgb{};
-    rgb.rgbBlue = *(data++);
-    rgb.rgbGreen = *(data++);
-    rgb.rgbRed = *(data++);
-    data++;
-    return rgb;
-}
-static RGBQUAD BGRdecoder(const char*& data) {
-    RGBQUAD rgb{};
-    rgb.rgbBlue = *(data++);
-    rgb.rgbGreen = *(data++);
-    rgb.rgbRed = *(data++);
-    return rgb;
-}
-static RGBQUAD ABGRdecoder(const char*& data) {
-    RGBQUAD rgb{};
-    data++;
-    rgb.rgbBlue = *(data++);
-    rgb.rgbGreen = *(data++);
-    rgb.rgbRed = *(data++);
-    return rgb;
-}
-static RGBQUAD BAGRdecoder(const char*& data) {
-    RGBQUAD rgb{};
-    rgb.rgbBlue = *(data++);
-    data++;
-    rgb.rgbGreen = *(data++);
-    rgb.rgbRed = *(data++);
-    return rgb;
-}
-static RGBQUAD GSdecoder(const char*& data) {
-    RGBQUAD rgb{};
-    rgb.rgbRed = *data;
-    rgb.rgbGreen = *data;
-    rgb.rgbBlue = *data;
-    data++;
-    return rgb;
-}
-static RGBQUAD CMYdecoder(const char*& data) {
-    RGBQUAD rgb{};
-    rgb.rgbRed = 0xFF - *(data++);
-    rgb.rgbGreen = 0xFF - *(data++);
-    rgb.rgbBlue = 0xFF - *(data++);
-    return rgb;
-}
-static RGBQUAD CMYKdecoder(const char*& data) {
-    RGBQUAD rgb = CMYdecoder(data);
-    unsigned char black = *(data++);
-    rgb.rgbRed -= black;
-    rgb.rgbGreen -= black;
-    rgb.rgbBlue -= black;
-    return rgb;
-}
-static RGBQUAD HSLdecoder(const char*& data) {
-    const uint8_t h = *(data++), s = *(data++), l = *(data++);
-    if (s == 0) {
-        RGBQUAD rgb{};
-        rgb.rgbRed = l;
-        rgb.rgbGreen = l;
-        rgb.rgbBlue = l;
-        return rgb;
-    }
-    const uint8_t q = l < 128 ? l + (l*s) / 255 : l + s - (l*s) / 255;
-    const uint8_t p = 2 * l - q;
-    RGBQUAD rgb{};
-    rgb.rgbRed = hueToRgb(p, q, h + 87);
-    rgb.rgbGreen = hueToRgb(p, q, h);
-    rgb.rgbBlue = hueToRgb(p, q, h - 87);
-    return rgb;
-}
-static RGBQUAD HSLAdecoder(const char*& data) {
-    RGBQUAD rgb = HSLdecoder(data);
-    data++;
-    return rgb;
-}
-static RGBQUAD HSVdecoder(const char*& data) {
-    const uint8_t h = *(data++), s = *(data++), v = *(data++);
-    if (s == 0) {
-        RGBQUAD rgb;
-        rgb.rgbRed = v;
-        rgb.rgbGreen = v;
-        rgb.rgbBlue = v;
-        return rgb;
-    }
-    const uint8_t i = h / 42;
-    const uint8_t ff = (h % 42) * 6;
-    const uint8_t p = (v * (255 - s)) / 255;
-    const uint8_t q = (v * ((255 * 255) - (s * ff))) / (255 * 255);
-    const uint8_t t = (v * ((255 * 255) - (s * (255 - ff)))) / (255 * 255);
-    RGBQUAD rgb;
-    switch (i) {
-    case 0:
-        rgb.rgbRed = v;
-        rgb.rgbGreen = t;
-        rgb.rgbBlue = p;
-        break;
-    case 1:
-        rgb.rgbRed = q;
-        rgb.rgbGreen = v;
-        rgb.rgbBlue = p;
-        break;
-    case 2:
-        rgb.rgbRed = p;
-        rgb.rgbGreen = v;
-        rgb.rgbBlue = t;
-        break;
-
-    case 3:
-        rgb.rgbRed = p;
-        rgb.rgbGreen = q;
-        rgb.rgbBlue = v;
-        break;
-    case 4:
-        rgb.rgbRed = t;
-        rgb.rgbGreen = p;
-        rgb.rgbBlue = v;
-        break;
-    case 5:
-    default:
-        rgb.rgbRed = v;
-        rgb.rgbGreen = p;
-        rgb.rgbBlue = q;
-        break;
-    }
-    return rgb;
-}
-static RGBQUAD HSVAdecoder(const char*& data) {
-    RGBQUAD rgb = HSVdecoder(data);
-    data++;
-    return rgb;
-}
-static RGBQUAD Pythondecoder(const char*& data) {
-    const long double*& fdata = reinterpret_cast<const long double*&>(data);
-    const long double h = *(fdata++), s = *(fdata++), l = *(fdata++);
-    fdata++;
-    if (s == 0) {
-        RGBQUAD rgb{};
-        rgb.rgbRed = l * 255;
-        rgb.rgbGreen = l * 255;
-        rgb.rgbBlue = l * 255;
-        return rgb;
-    }
-    const long double q = l < 0.5L ? l * (1 + s) : l + s - (l * s);
-    const long double p = 2 * l - q;
-    RGBQUAD rgb{};
-    rgb.rgbRed = pythonHueToRgb(p, q, h + 120);
-    rgb.rgbGreen = pythonHueToRgb(p, q, h);
-    rgb.rgbBlue = pythonHueToRgb(p, q, h - 120);
-    return rgb;
+    };
+    loader.reset(new ImageLoader(guarded, [] { PostMessageW(hwnd, WM_DECODED, 0, 0); }));
+    fitWindowToImage();
+}
+// Shows the rows decoded since the last call, and reports a broken file once the loader is done.
+static void showDecoded() {
+    if (!loader) return;
+    bool done, failed;
+    uint64_t decoded = loader->poll(done, failed);
+    if (decoded != decodedpixels) {
+        decodedpixels = decoded;
+        // Only what the new rows change is halved, the tiles that reach past the decoded rows are scaled again
+        if (pyramid.levelCount() != 0) pyramid.update(static_cast<size_t>(decoded / pyramid.level(0).width));
+        InvalidateRect(hwnd, NULL, FALSE);
+    }
+    if (!done) return;
+    loader.reset();
+    if (failed) MessageBoxExW(NULL, loaderror, L"Error", MB_OK | MB_ICONERROR, NULL);
 }
 static void openFile(const wchar_t* path)
 {
     // .txt files store bytes as sequences of '0' and '1', this unnecessarily increases the file size by a factor of 8
-    ImageFormat fmt = endsWith(path, L".bin") ? ImageFormat::bin : endsWith(path, L".txt") ? ImageFormat::txt : ImageFormat::invalid;
+    ImageFormat fmt = get_imageFormat(path);
     if (fmt == ImageFormat::invalid) {
         openwicfile(path);
         return;
     }
-    // Open the file for reading asynchronously
-    HANDLE file = CreateFileW(path, FILE_GENERIC_READ, NULL, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED, NULL);
-    // Get the file size
-    size_t fileSize;
-    {
-        LARGE_INTEGER fileSizeLargeInteger;
-        GetFileSizeEx(file, &fileSizeLargeInteger);
-        fileSize = fileSizeLargeInteger.QuadPart;
+    // .bin, .ikt and .iktz files are decoded straight from a mapping, .txt and .qoi files and .bin files that can't be mapped are streamed in chunks
+    std::shared_ptr<MappedFile> mapping(new MappedFile());
+    std::shared_ptr<InputFile> stream(new InputFile());
+    bool mapped = fmt != ImageFormat::txt && fmt != ImageFormat::qoi && mapping->open(path);
+    if (!mapped && ((fmt != ImageFormat::bin && fmt != ImageFormat::txt && fmt != ImageFormat::qoi) || !stream->open(path))) {
+        MessageBoxExW(NULL, L"Failed to open the file.", L"Error", MB_OK | MB_ICONERROR, NULL);
+        return;
     }
+    size_t fileSize = mapped ? mapping->size() : stream->size();
     // fileSize is now in bytes.
     if (fmt == ImageFormat::txt) {
         if (fileSize % 8 != 0) {
             MessageBoxExW(NULL, L".txt files need to be a multiple of 8 bytes", L"Error", MB_OK | MB_ICONERROR, NULL);
-            CloseHandle(file);
             return;
         }
         fileSize /= 8;
     }
-    // Querries for image dimensions
-    size_t pixelSize;
-    {
+    // .ikt, .iktz and .qoi files describe themselves, the others querry for image dimensions. The new size stays here
+    // until the image is replaced, the window keeps painting the old one while dialogs are up
+    ImageHeader header;
+    CompressedHeader compressed;
+    QoiHeader qoi;
+    ImageQuery query{ width, height, colorformat };
+    if (fmt == ImageFormat::ikt || fmt == ImageFormat::iktz || fmt == ImageFormat::qoi) {
+        HeaderStatus status;
+        if (fmt == ImageFormat::ikt) {
+            status = readImageHeader(mapping->data(), mapping->size(), header);
+            query = ImageQuery{ static_cast<int64_t>(header.width), static_cast<int64_t>(header.height), header.cf };
+        }
+        else if (fmt == ImageFormat::iktz) {
+            status = readCompressedHeader(mapping->data(), mapping->size(), compressed);
+            query = ImageQuery{ static_cast<int64_t>(compressed.width), static_cast<int64_t>(compressed.height), compressed.cf };
+        }
+        else {
+            // The rest of the file is streamed from after the header
+            uint8_t data[qoiHeaderSize];
+            size_t count;
+            status = stream->read(data, sizeof(data), count) ? readQoiHeader(data, stream->size(), qoi) : HeaderStatus::invalid;
+            query.width = qoi.width;
+            query.height = qoi.height;
+        }
+        if (status != HeaderStatus::ok) {
+            const wchar_t* message = status == HeaderStatus::newerVersion ? L"The file was written by a newer version of the viewer." :
+                status == HeaderStatus::truncated ? L"The file is shorter than its header says." : L"The file's header is invalid.";
+            MessageBoxExW(NULL, message, L"Error", MB_OK | MB_ICONERROR, NULL);
+            return;
+        }
+    }
+    else {
+        size_t pixelSize;
         int option;
     retrypoint:
-        DialogBoxW(GetModuleHandle(NULL), MAKEINTRESOURCE(IDD_QUERY_DIALOG), hwnd, QueryDialogProc);
-        pixelSize = get_pixelSize(colorformat);
-        if (fileSize != width * height * pixelSize) {
+        DialogBoxParamW(GetModuleHandle(NULL), MAKEINTRESOURCE(IDD_QUERY_DIALOG), hwnd, QueryDialogProc, reinterpret_cast<LPARAM>(&query));
+        pixelSize = get_pixelSize(query.cf);
+        if (fileSize != query.width * query.height * pixelSize) {
             option = MessageBoxExW(NULL, L"The size or color model you entered doesn't match the file size, continue anyway?", L"Error", MB_ABORTRETRYIGNORE | MB_ICONERROR, NULL);
-            if (option == IDRETRY) {
-                width = oldwidth;
-                height = oldheight;
-                goto retrypoint;
-            }
-            if (option == IDABORT) {
-                width = oldwidth;
-                height = oldheight;
-                CloseHandle(file);
-                return;
-            }
+            if (option == IDRETRY) goto retrypoint;
+            if (option == IDABORT) return;
         }
     }
-    // Allocates space for raw color data
-    {
+    ColorFormat cf = query.cf;
+    int64_t imageWidth = query.width, imageHeight = query.height;
+    // .bin and .ikt files holding the whole image can stay where they are if there isn't enough memory for them
+    bool storable = mapped && (fmt == ImageFormat::ikt || (fmt == ImageFormat::bin && fileSize >= imageWidth * imageHeight * get_pixelSize(cf)));
+    uint64_t storeoffset = fmt == ImageFormat::ikt ? header.dataOffset : 0;
+    size_t storestride = fmt == ImageFormat::ikt ? header.stride : imageWidth * get_pixelSize(cf);
+    if (storable && !fitsInMemory(imageWidth * imageHeight * sizeof(Pixel))) {
+        mapping->close();
+        if (!openStore(path, storeoffset, storestride, cf, imageWidth, imageHeight))
+            MessageBoxExW(NULL, L"Failed to open the file.", L"Error", MB_OK | MB_ICONERROR, NULL);
+        return;
+    }
+    // Allocates space for raw color data, the previous image stays until the new one is decoded
+    HBITMAP bitmap = NULL;
+    Pixel* pixels = NULL;
+    if (fitsDibSection(imageWidth, imageHeight)) {
         BITMAPINFO bitmapinfo;
         ZeroMemory(&bitmapinfo, sizeof(BITMAPINFO));
         bitmapinfo.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
-        bitmapinfo.bmiHeader.biWidth = width;
-        bitmapinfo.bmiHeader.biHeight = -height;
+        bitmapinfo.bmiHeader.biWidth = static_cast<LONG>(imageWidth);
+        bitmapinfo.bmiHeader.biHeight = -static_cast<LONG>(imageHeight);
         bitmapinfo.bmiHeader.biPlanes = 1;
         bitmapinfo.bmiHeader.biBitCount = 32;
         bitmapinfo.bmiHeader.biCompression = BI_RGB;
-        if (imagebitmap != NULL) DeleteObject(imagebitmap);
-        imagebitmap = CreateDIBSection(NULL, &bitmapinfo, DIB_RGB_COLORS, reinterpret_cast<void**>(&imagedata), NULL, NULL);
-    }
-    // The entire file is read into data before it can be parsed
-    char* data = new char[fileSize * (fmt == ImageFormat::txt ? 8 : 1)];
-    {
-        OVERLAPPED overlapped;
-        ZeroMemory(&overlapped, sizeof(OVERLAPPED));
-        overlapped.hEvent = CreateEventExW(NULL, NULL, CREATE_EVENT_MANUAL_RESET, EVENT_MODIFY_STATE | SYNCHRONIZE);
-        (void)ReadFileEx(file, data, fileSize * (fmt == ImageFormat::txt ? 8 : 1), &overlapped, readfileexCallback);
-        (void)WaitForSingleObjectEx(overlapped.hEvent, 1000, TRUE);
-        CloseHandle(file);
+        bitmap = CreateDIBSection(NULL, &bitmapinfo, DIB_RGB_COLORS, reinterpret_cast<void**>(&pixels), NULL, NULL);
     }
-    // Converts to binary data
-    if (fmt == ImageFormat::txt) {
-        char* current = data;
-        for (size_t i = 0; i < fileSize; i++)
-            data[i] = readtxtbyte(current);
-    }
-    // fileSize is now in pixels
-    fileSize /= pixelSize;
-    // Reads only the data found in the file, overflow repeats the image. data is deleted as it is no longer needed.
-    {
-        ColorFormatDecoder decoder;
-        switch (colorformat)
-        {
-        case ColorFormat::Invalid:
-        default:
-        case ColorFormat::RGBA:
-            decoder = RGBAdecoder;
-            break;
-        case ColorFormat::RGB:
-            decoder = RGBdecoder;
-            break;
-        case ColorFormat::ARGB:
-            decoder = ARGBdecoder;
-            break;
-        case ColorFormat::BGRA:
-            decoder = BGRAdecoder;
-            break;
-        case ColorFormat::BGR:
-            decoder = BGRdecoder;
-            break;
-        case ColorFormat::ABGR:
-            decoder = ABGRdecoder;
-            break;
-        case ColorFormat::BAGR:
-            decoder = BAGRdecoder;
-            break;
-        case ColorFormat::GrayScale:
-            decoder = GSdecoder;
-            break;
-        case ColorFormat::CMY:
-            decoder = CMYdecoder;
-            break;
-        case ColorFormat::CMYK:
-            decoder = CMYKdecoder;
-            break;
-        case ColorFormat::HSL:
-            decoder = HSLdecoder;
-            break;
-        case ColorFormat::HSLA:
-            decoder = HSLAdecoder;
-            break;
-        case ColorFormat::HSV:
-            decoder = HSVdecoder;
-            break;
-        case ColorFormat::HSVA:
-            decoder = HSVAdecoder;
-            break;
-        case ColorFormat::Python:
-            decoder = Pythondecoder;
-            break;
-        }
-        size_t imageSize = width * height;
-        size_t loopCount = min(fileSize, imageSize);
-        const char* current = data;
-        for (size_t i = 0; i < loopCount; i++)
-            imagedata[i] = decoder(current);
-        for (size_t i = loopCount; i < imageSize; i++)
-            imagedata[i] = imagedata[i % loopCount];
-        delete[] data;
+    if (bitmap == NULL && storable) {
+        mapping->close();
+        if (openStore(path, storeoffset, storestride, cf, imageWidth, imageHeight)) return;
     }
-    // Adjusts the window to match the size of the image and redraws it.
-    {
-        RECT rect;
-        GetWindowRect(hwnd, &rect);
-        rect.right = rect.left + width;
-        rect.bottom = rect.top + height;
-        AdjustWindowRect(&rect, mydwstyle, TRUE);
-        MoveWindow(hwnd, rect.left, rect.top, rect.right - rect.left, rect.bottom - rect.top, FALSE);
-        InvalidateRect(hwnd, NULL, TRUE);
-        menuredraw = true;
+    if (bitmap == NULL) {
+        MessageBoxExW(NULL, L"Not enough memory for an image this size.", L"Error", MB_OK | MB_ICONERROR, NULL);
+        return;
     }
+    // Reads only the data found in the file, overflow repeats the image. The whole of a .txt file is checked so a broken file is reported only once.
+    // The decoding runs in the background from here on, the window shows the rows that are done while the rest follows
+    ImageLoader::Job job;
+    if (fmt == ImageFormat::ikt) {
+        job = [=](const DecodeProgress& progress) {
+            decodeRows(reinterpret_cast<const char*>(mapping->data() + header.dataOffset), header.stride, cf, pixels, imageWidth, imageHeight, progress);
+            return true;
+        };
+    }
+    else if (fmt == ImageFormat::iktz) {
+        job = [=](const DecodeProgress& progress) {
+            if (decodeCompressed(mapping->data(), mapping->size(), compressed, pixels, progress)) return true;
+            swprintf_s(loaderror, L"The file is corrupt.");
+            return false;
+        };
+    }
+    else if (mapped) {
+        job = [=](const DecodeProgress& progress) {
+            decodeImage(reinterpret_cast<const char*>(mapping->data()), mapping->size(), cf, pixels, imageWidth * imageHeight, progress);
+            return true;
+        };
+    }
+    else {
+        job = [=](const DecodeProgress& progress) {
+            TextError error;
+            StreamStatus status = decodeFile(*stream, fmt, cf, pixels, imageWidth * imageHeight, error, progress);
+            if (status == StreamStatus::invalidText)
+                swprintf_s(loaderror, L".txt files can only contain '0' and '1' characters. Found %llu other characters, the first one at offset %llu.", (unsigned long long)error.count, (unsigned long long)error.firstOffset);
+            else if (status == StreamStatus::truncated)
+                swprintf_s(loaderror, L"The file ends before the image does.");
+            else if (status == StreamStatus::readError)
+                swprintf_s(loaderror, L"Failed to read the file.");
+            return status == StreamStatus::ok;
+        };
+    }
+    startDecoding(bitmap, pixels, cf, imageWidth, imageHeight, job);
 }
 static wchar_t* openFileDialog() {
     wchar_t* out = new wchar_t[MAX_PATH];
@@ -855,227 +656,67 @@ static wchar_t* openFileDialog() {
     }
     return out;
 }
-static void RGBAencoder(char*& data, RGBQUAD color) {
-    *(data++) = color.rgbRed;
-    *(data++) = color.rgbGreen;
-    *(data++) = color.rgbBlue;
-    *(data++) = 0x00;
-}
-static void RGBencoder(char*& data, RGBQUAD color) {
-    *(data++) = color.rgbRed;
-    *(data++) = color.rgbGreen;
-    *(data++) = color.rgbBlue;
-}
-static void ARGBencoder(char*& data, RGBQUAD color) {
-    *(data++) = 0x00;
-    *(data++) = color.rgbRed;
-    *(data++) = color.rgbGreen;
-    *(data++) = color.rgbBlue;
-}
-static void BGRAencoder(char*& data, RGBQUAD color) {
-    *(data++) = color.rgbBlue;
-    *(data++) = color.rgbGreen;
-    *(data++) = color.rgbRed;
-    *(data++) = 0x00;
-}
-static void BGRencoder(char*& data, RGBQUAD color) {
-    *(data++) = color.rgbBlue;
-    *(data++) = color.rgbGreen;
-    *(data++) = color.rgbRed;
-}
-static void ABGRencoder(char*& data, RGBQUAD color) {
-    *(data++) = 0x00;
-    *(data++) = color.rgbBlue;
-    *(data++) = color.rgbGreen;
-    *(data++) = color.rgbRed;
-}
-static void BAGRencoder(char*& data, RGBQUAD color) {
-    *(data++) = color.rgbBlue;
-    *(data++) = 0x00;
-    *(data++) = color.rgbGreen;
-    *(data++) = color.rgbRed;
-}
-static void GSencoder(char*& data, RGBQUAD color) {
-    *(data++) = (color.rgbRed + color.rgbGreen + color.rgbBlue) / 3;
-}
-static void CMYencoder(char*& data, RGBQUAD color) {
-    *(data++) = 0xFF - color.rgbRed;
-    *(data++) = 0xFF - color.rgbGreen;
-    *(data++) = 0xFF - color.rgbBlue;
-}
-static void CMYKencoder(char*& data, RGBQUAD color) {
-    unsigned char c = 0xFF - color.rgbRed;
-    unsigned char m = 0xFF - color.rgbGreen;
-    unsigned char y = 0xFF - color.rgbBlue;
-    unsigned char k = min(c, min(m, y));
-    *(data++) = c - k;
-    *(data++) = m - k;
-    *(data++) = y - k;
-    *(data++) = k;
-}
-static void HSLencoder(char*& data, RGBQUAD color) {
-    const uint8_t r = color.rgbRed, g = color.rgbGreen, b = color.rgbBlue;
-    const uint8_t max = max(max(r, g), b),  min = min(min(r, g), b);
-    const uint8_t l = (max + min) / 2;
-    if (max == min) {
-        *(data++) = 0;
-        *(data++) = 0;
-        *(data++) = l;
+static void saveFile(const wchar_t* path)
+{
+    // Image must first be opened before it is saved
+    if (imagedata == nullptr && !imagestore) {
+        MessageBoxExW(NULL, L"Open a file first before saving it", L"Unable to save", MB_OK | MB_ICONWARNING, NULL);
         return;
     }
-    const uint8_t d = max - min;
-    const uint8_t s = (l > 127) ? 255 * d / (2 * 255 - max - min) : 255 * d / (max + min);
-    const uint8_t h = (max == r) ? ((g - b) * 42) / d : (max == g) ? ((b - r) * 42) / d + 84 : ((r - g) * 42) / d + 168;
-    *(data++) = h;
-    *(data++) = s;
-    *(data++) = l;
-    return;
-}
-static void HSLAencoder(char*& data, RGBQUAD color) {
-    HSLencoder(data, color);
-    *(data++) = 0x00;
-    return;
-}
-static void HSVencoder(char*& data, RGBQUAD color) {
-    const uint8_t r = color.rgbRed, g = color.rgbGreen, b = color.rgbBlue;
-    const uint8_t max = max(max(r, g), b), min = min(min(r, g), b);
-    const uint8_t d = max - min;
-    if (d == 0)
-    {
-        *(data++) = 0;
-        *(data++) = 0;
-        *(data++) = max;
+    // Saving waits for the decode to finish, so all of the image is saved
+    if (loader) {
+        loader->wait();
+        showDecoded();
+    }
+    ImageFormat fmt = get_imageFormat(path);
+    if (fmt == ImageFormat::invalid) {
+        if (imagestore) MessageBoxExW(NULL, L"Images too large for memory can only be saved as .bin, .ikt, .iktz, .qoi or .txt.", L"Unable to save", MB_OK | MB_ICONWARNING, NULL);
+        else savewicfile(path);
         return;
     }
-    const uint8_t s = 255 * d / max;
-    const uint8_t h = (max == r) ? ((g - b) * 42) / d : (max == g) ? ((b - r) * 42) / d + 84 : ((r - g) * 42) / d + 168;
-    *(data++) = h;
-    *(data++) = s;
-    *(data++) = max;
-    return;
-}
-static void HSVAencoder(char*& data, RGBQUAD color) {
-    HSVencoder(data, color);
-    *(data++) = 0x00;
-    return;
-}
-static void Pythonencoder(char*& data, RGBQUAD color) {
-    const uint8_t r = color.rgbRed, g = color.rgbGreen, b = color.rgbBlue;
-    const uint8_t max = max(max(r, g), b), min = min(min(r, g), b);
-    const uint16_t l = max + min;
-    long double*& fdata = reinterpret_cast<long double*&>(data);
-
-    if (max == min) {
-        *(fdata++) = 0.0L;
-        *(fdata++) = 0.0L;
-        *(fdata++) = l / 512.0L;
-        *(fdata++) = 0.0L;
+    // Images left in their file are read a chunk at a time, so that file mustn't be the one written
+    if (imagestore && isSameFile(path, storepath.c_str())) {
+        MessageBoxExW(NULL, L"Images too large for memory can't be saved over the file they are shown from.", L"Unable to save", MB_OK | MB_ICONWARNING, NULL);
         return;
     }
-
-    const uint8_t d = max - min;
-    const long double s = (l > 255) ? d / static_cast<long double>(2 * 255 - max - min) : d / static_cast<long double>(max + min);
-    const long double h = (max == r) ? ((g - b) * 60) / static_cast<long double>(d) + (g < b ? 3600.L : 0.0L) : (max == g) ? ((b - r) * 60) / static_cast<long double>(d) + 120 : ((r - g) * 60) / static_cast<long double>(d) + 240;
-    *(fdata++) = h;
-    *(fdata++) = s;
-    *(fdata++) = l / 512.0L;
-    *(fdata++) = 0.0L;
-    return;
-}
-static void saveFile(const wchar_t* path)
-{
-    // Image must first be opened before it is saved
-    if (imagedata == nullptr) {
-        MessageBoxExW(NULL, L"Open a file first before saving it", L"Unable to save", MB_OK | MB_ICONWARNING, NULL);
+    PixelSource source = imagestore ? imagestore->get_source() : get_pixelSource(imagedata);
+    // .qoi has its own color model, the raw formats ask for one
+    if (fmt != ImageFormat::qoi) DialogBoxW(GetModuleHandle(NULL), MAKEINTRESOURCE(IDD_COLORMODEL_DIALOG), hwnd, ColorQueryDialogProc);
+    // Checked before the file is created, the writer refuses rows wider than a block
+    if (fmt == ImageFormat::iktz && static_cast<uint64_t>(width) > get_compressedMaxWidth(colorformat)) {
+        MessageBoxExW(NULL, L"The image is too wide for .iktz in this color model.", L"Unable to save", MB_OK | MB_ICONWARNING, NULL);
         return;
     }
-    ImageFormat fmt = endsWith(path, L".bin") ? ImageFormat::bin : endsWith(path, L".txt") ? ImageFormat::txt : ImageFormat::invalid;
-    if (fmt == ImageFormat::invalid) {
-        savewicfile(path);
+    // Create or open the file for writing
+    OutputFile file;
+    if (!file.open(path)) {
+        MessageBoxExW(NULL, L"Failed to create the file.", L"Error", MB_OK | MB_ICONERROR, NULL);
         return;
     }
-    DialogBoxW(GetModuleHandle(NULL), MAKEINTRESOURCE(IDD_COLORMODEL_DIALOG), hwnd, ColorQueryDialogProc);
-    // Create or open the file for writing asynchronously
-    HANDLE file = CreateFileW(path, FILE_GENERIC_WRITE, NULL, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED, NULL);
-    size_t fileSize = width * height; // in pixels
-    size_t pixelSize = get_pixelSize(colorformat);
-    char* data = new char[fileSize * pixelSize];
-    // The image is parsed and copied to a new buffer
-    {
-        ColorFormatEncoder encoder;
-        switch (colorformat)
-        {
-        case ColorFormat::Invalid:
-        default:
-        case ColorFormat::RGBA:
-            encoder = RGBAencoder;
-            break;
-        case ColorFormat::RGB:
-            encoder = RGBencoder;
-            break;
-        case ColorFormat::ARGB:
-            encoder = ARGBencoder;
-            break;
-        case ColorFormat::BGRA:
-            encoder = BGRAencoder;
-            break;
-        case ColorFormat::BGR:
-            encoder = BGRencoder;
-            break;
-        case ColorFormat::ABGR:
-            encoder = ABGRencoder;
-            break;
-        case ColorFormat::BAGR:
-            encoder = BAGRencoder;
-            break;
-        case ColorFormat::GrayScale:
-            encoder = GSencoder;
-            break;
-        case ColorFormat::CMY:
-            encoder = CMYencoder;
-            break;
-        case ColorFormat::CMYK:
-            encoder = CMYKencoder;
-            break;
-        case ColorFormat::HSL:
-            encoder = HSLencoder;
-            break;
-        case ColorFormat::HSLA:
-            encoder = HSLAencoder;
-            break;
-        case ColorFormat::HSV:
-            encoder = HSVencoder;
-            break;
-        case ColorFormat::HSVA:
-            encoder = HSVAencoder;
-            break;
-        case ColorFormat::Python:
-            encoder = Pythonencoder;
-            break;
+    // The image is encoded a few MB at a time while the previous pieces are being written, .txt is expanded into characters straight before writing.
+    // .ikt files start with a header, so they open again without the dialog. .iktz files are compressed in blocks on the thread pool
+    bool ok, memory = true;
+    try {
+        if (fmt == ImageFormat::iktz) ok = encodeCompressed(file, colorformat, source, width, height);
+        else if (fmt == ImageFormat::qoi) {
+            QoiHeader header;
+            header.width = static_cast<uint32_t>(width);
+            header.height = static_cast<uint32_t>(height);
+            uint8_t data[qoiHeaderSize];
+            writeQoiHeader(header, data);
+            ok = file.write(data, sizeof(data)) && encodeFile(file, fmt, colorformat, source, width * height);
         }
-        char* current = data;
-        for (size_t i = 0; i < fileSize; ++i)
-            encoder(current, imagedata[i]);
-    }
-    if (fmt == ImageFormat::txt) {
-        char* olddata = data;
-        data = new char[fileSize * pixelSize * 8];
-        char* current = data;
-        for (size_t i = 0; i < fileSize * pixelSize; ++i) {
-            writetxtbyte(current, olddata[i]);
+        else {
+            ok = fmt != ImageFormat::ikt || writeImageHeader(file, makeImageHeader(colorformat, width, height));
+            ok = ok && encodeFile(file, fmt, colorformat, source, width * height);
         }
-        delete[] olddata;
     }
-    // Saving the image
-    {
-        OVERLAPPED overlapped;
-        ZeroMemory(&overlapped, sizeof(OVERLAPPED));
-        overlapped.hEvent = CreateEventExW(NULL, NULL, CREATE_EVENT_MANUAL_RESET, EVENT_MODIFY_STATE | SYNCHRONIZE);
-        (void)WriteFileEx(file, data, fileSize * pixelSize * (fmt == ImageFormat::txt ? 8 : 1), &overlapped, writefileexCallback);
-        (void)WaitForSingleObjectEx(overlapped.hEvent, 1000, TRUE);
-        delete[] data;
+    catch (const std::bad_alloc&) {
+        ok = memory = false;
     }
-    CloseHandle(file);
+    ok = file.close() && ok;
+    if (!memory) MessageBoxExW(NULL, L"Not enough memory to save the image.", L"Error", MB_OK | MB_ICONERROR, NULL);
+    else if (!ok) MessageBoxExW(NULL, L"Failed to write the file.", L"Error", MB_OK | MB_ICONERROR, NULL);
     // MessageBoxExW(NULL, L"File saved successfully", L"Success", MB_OK | MB_ICONINFORMATION, NULL);
 }
 static wchar_t* saveFileDialog() {
@@ -1111,6 +752,26 @@ static wchar_t* saveFileDialog() {
     }
     return out;
 }
+// Drops everything made from the image and fits the next one in the window.
+static void releaseView() {
+    pyramid.clear();
+    tilecache.clear();
+    fitview = true;
+}
+// Zooms by factor keeping the pixel under x, y of the window in place. The image can shrink down to fit in the
+// window or to 1:1, whichever is smaller.
+static void zoomAt(double factor, int x, int y) {
+    if (width == 0 || height == 0) return;
+    View fit = fitView(width, height, windowwidth, windowheight);
+    double scale = view.scale * factor;
+    double minzoom = fit.scale < 1.0 ? fit.scale : 1.0;
+    scale = scale < minzoom ? minzoom : scale > maxzoom ? maxzoom : scale;
+    // Zooming near 1:1 snaps to it, so inspecting pixels doesn't depend on where the zooming started
+    if (scale > 0.95 && scale < 1.05) scale = 1.0;
+    view = clampView(zoomView(view, scale, x, y, width, height), width, height, windowwidth, windowheight);
+    fitview = false;
+    InvalidateRect(hwnd, NULL, FALSE);
+}
 static LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 {
     switch (uMsg)
@@ -1118,8 +779,52 @@ static LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM l
     case WM_SIZE:
         windowwidth = LOWORD(lParam);
         windowheight = HIWORD(lParam);
+        if (!fitview) view = clampView(view, width, height, windowwidth, windowheight);
         InvalidateRect(hwnd, NULL, TRUE);
         return 0;
+    case WM_MOUSEWHEEL:
+    {
+        // A notch zooms by a quarter of an octave
+        POINT point = { static_cast<short>(LOWORD(lParam)), static_cast<short>(HIWORD(lParam)) };
+        ScreenToClient(hwnd, &point);
+        zoomAt(pow(2.0, GET_WHEEL_DELTA_WPARAM(wParam) / (4.0 * WHEEL_DELTA)), point.x, point.y);
+    }
+        return 0;
+    case WM_LBUTTONDOWN:
+        panning = true;
+        panx = static_cast<short>(LOWORD(lParam));
+        pany = static_cast<short>(HIWORD(lParam));
+        SetCapture(hwnd);
+        return 0;
+    case WM_MOUSEMOVE:
+        if (panning && width != 0 && height != 0) {
+            int x = static_cast<short>(LOWORD(lParam)), y = static_cast<short>(HIWORD(lParam));
+            view.x -= x - panx;
+            view.y -= y - pany;
+            view = clampView(view, width, height, windowwidth, windowheight);
+            panx = x;
+            pany = y;
+            fitview = false;
+            InvalidateRect(hwnd, NULL, FALSE);
+        }
+        return 0;
+    case WM_LBUTTONUP:
+        panning = false;
+        ReleaseCapture();
+        return 0;
+    case WM_CAPTURECHANGED:
+        panning = false;
+        return 0;
+    case WM_KEYDOWN:
+        // 0 or Home fits the image in the window, 1 shows it 1:1, + and - zoom around the middle of the window
+        if (wParam == '0' || wParam == VK_HOME) {
+            fitview = true;
+            InvalidateRect(hwnd, NULL, FALSE);
+        }
+        else if (wParam == '1') zoomAt(1.0 / view.scale, windowwidth / 2, windowheight / 2);
+        else if (wParam == VK_ADD || wParam == VK_OEM_PLUS) zoomAt(2.0, windowwidth / 2, windowheight / 2);
+        else if (wParam == VK_SUBTRACT || wParam == VK_OEM_MINUS) zoomAt(0.5, windowwidth / 2, windowheight / 2);
+        return 0;
     case WM_COMMAND:
         switch (LOWORD(wParam)) {
         case 1:
@@ -1146,7 +851,11 @@ static LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM l
             break;
         }
         return 0;
+    case WM_DECODED:
+        showDecoded();
+        return 0;
     case WM_DESTROY:
+        loader.reset();
         PostQuitMessage(0);
         return 0;
 
@@ -1159,23 +868,43 @@ static LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM l
             if (menuredraw) DrawMenuBar(hwnd);
             return 0;
         }
-        SetStretchBltMode(hdc, HALFTONE);
-        HDC image = CreateCompatibleDC(hdc);
-        HGDIOBJ old = SelectObject(image, imagebitmap);
-        if (windowwidth * height > windowheight * width ) {
-            int displaywidth = width * windowheight / height;
-            RECT rect = { 0, 0, windowwidth, windowheight };
-            FillRect(hdc, &rect, (HBRUSH)GetStockObject(BLACK_BRUSH));
-            StretchBlt(hdc, (windowwidth - displaywidth) / 2, 0, displaywidth, windowheight, image, 0, 0, width, height, SRCCOPY);
+        if (windowwidth == 0 || windowheight == 0) {
+            EndPaint(hwnd, &ps);
+            return 0;
+        }
+        if (pyramid.levelCount() == 0) {
+            // The levels of an image left in its file take at most a quarter of the memory
+            MEMORYSTATUSEX status;
+            status.dwLength = sizeof(status);
+            if (imagestore) pyramid.build(*imagestore, GlobalMemoryStatusEx(&status) ? static_cast<size_t>(status.ullTotalPhys / 4) : storebudget);
+            else pyramid.build(imagedata, width, height, static_cast<size_t>(std::min<uint64_t>(decodedpixels / width, height)));
         }
-        else {
-            int displayheight = height * windowwidth / width;
-            RECT rect = { 0, 0, windowwidth, windowheight };
-            FillRect(hdc, &rect, (HBRUSH)GetStockObject(BLACK_BRUSH));
-            StretchBlt(hdc, 0, (windowheight - displayheight) / 2, windowwidth, displayheight, image, 0, 0, width, height, SRCCOPY);
+        if (fitview) view = fitView(width, height, windowwidth, windowheight);
+        // Black bars where the image doesn't cover the window, filled around it so nothing flickers
+        int64_t left = -view.x, top = -view.y;
+        int64_t right = left + get_scaledSize(width, view.scale), bottom = top + get_scaledSize(height, view.scale);
+        RECT bars[4] = {
+            { 0, 0, windowwidth, static_cast<LONG>(top > 0 ? top : 0) },
+            { 0, static_cast<LONG>(bottom < windowheight ? bottom : windowheight), windowwidth, windowheight },
+            { 0, 0, static_cast<LONG>(left > 0 ? left : 0), windowheight },
+            { static_cast<LONG>(right < windowwidth ? right : windowwidth), 0, windowwidth, windowheight },
+        };
+        for (const RECT& bar : bars) {
+            if (bar.right > bar.left && bar.bottom > bar.top) FillRect(hdc, &bar, (HBRUSH)GetStockObject(BLACK_BRUSH));
         }
-        SelectObject(image, old);
-        DeleteDC(image);
+        // Only the tiles in the invalid part of the window are drawn, the ones not cached yet are scaled first
+        BITMAPINFO bitmapinfo;
+        ZeroMemory(&bitmapinfo, sizeof(BITMAPINFO));
+        bitmapinfo.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+        bitmapinfo.bmiHeader.biPlanes = 1;
+        bitmapinfo.bmiHeader.biBitCount = 32;
+        bitmapinfo.bmiHeader.biCompression = BI_RGB;
+        tilecache.draw(view, ps.rcPaint.left, ps.rcPaint.top, ps.rcPaint.right, ps.rcPaint.bottom, [&](const ViewTile& tile) {
+            bitmapinfo.bmiHeader.biWidth = static_cast<LONG>(tile.width);
+            bitmapinfo.bmiHeader.biHeight = -static_cast<LONG>(tile.height);
+            SetDIBitsToDevice(hdc, static_cast<int>(tile.x), static_cast<int>(tile.y), static_cast<DWORD>(tile.width), static_cast<DWORD>(tile.height),
+                0, 0, 0, static_cast<UINT>(tile.height), tile.pixels, &bitmapinfo, DIB_RGB_COLORS);
+        });
         EndPaint(hwnd, &ps);
         if (menuredraw) DrawMenuBar(hwnd);
     }
@@ -0,0 +1,61 @@
+#include "ImageHeader.h"
+#include <cstring>
+
+static const uint8_t imageMagic[4] = { 'I', 'K', 'T', 0x1A };
+
+static uint64_t loadLittle(const uint8_t* data, int size) {
+    uint64_t value = 0;
+    for (int i = size - 1; i >= 0; i--) value = value << 8 | data[i];
+    return value;
+}
+static void storeLittle(uint8_t* data, uint64_t value, int size) {
+    for (int i = 0; i < size; i++, value >>= 8) data[i] = static_cast<uint8_t>(value);
+}
+
+ImageHeader makeImageHeader(ColorFormat cf, uint64_t width, uint64_t height) {
+    ImageHeader header;
+    header.cf = cf;
+    header.width = width;
+    header.height = height;
+    header.stride = width * get_pixelSize(cf);
+    header.dataOffset = (imageHeaderSize + imageDataAlignment - 1) / imageDataAlignment * imageDataAlignment;
+    return header;
+}
+HeaderStatus readImageHeader(const uint8_t* data, uint64_t fileSize, ImageHeader& header) {
+    if (fileSize < imageHeaderSize || memcmp(data, imageMagic, sizeof(imageMagic)) != 0) return HeaderStatus::invalid;
+    if (loadLittle(data + 4, 2) > imageHeaderVersion) return HeaderStatus::newerVersion;
+    uint64_t cf = loadLittle(data + 6, 2);
+    if (cf >= static_cast<uint64_t>(ColorFormat::Invalid)) return HeaderStatus::invalid;
+    header.cf = static_cast<ColorFormat>(cf);
+    header.width = loadLittle(data + 8, 8);
+    header.height = loadLittle(data + 16, 8);
+    header.stride = loadLittle(data + 24, 8);
+    header.dataOffset = loadLittle(data + 32, 8);
+    // Every product below is checked against the file size first, so nothing can overflow
+    uint64_t pixelSize = get_pixelSize(header.cf);
+    if (header.width == 0 || header.height == 0 || header.dataOffset < imageHeaderSize) return HeaderStatus::invalid;
+    if (header.width > UINT64_MAX / pixelSize || header.stride < header.width * pixelSize) return HeaderStatus::invalid;
+    if (header.dataOffset > fileSize) return HeaderStatus::truncated;
+    uint64_t available = fileSize - header.dataOffset;
+    if (header.height - 1 > available / header.stride || (header.height - 1) * header.stride + header.width * pixelSize > available)
+        return HeaderStatus::truncated;
+    return HeaderStatus::ok;
+}
+bool writeImageHeader(OutputFile& file, const ImageHeader& header) {
+    uint8_t data[imageDataAlignment] = {};
+    memcpy(data, imageMagic, sizeof(imageMagic));
+    storeLittle(data + 4, imageHeaderVersion, 2);
+    storeLittle(data + 6, static_cast<uint64_t>(header.cf), 2);
+    storeLittle(data + 8, header.width, 8);
+    storeLittle(data + 16, header.height, 8);
+    storeLittle(data + 24, header.stride, 8);
+    storeLittle(data + 32, header.dataOffset, 8);
+    // The padding is written from the same zeroed block
+    for (uint64_t written = 0; written < header.dataOffset; ) {
+        size_t size = static_cast<size_t>(header.dataOffset - written < sizeof(data) ? header.dataOffset - written : sizeof(data));
+        if (!file.write(data, size)) return false;
+        if (written == 0) memset(data, 0, imageHeaderSize);
+        written += size;
+    }
+    return true;
+}
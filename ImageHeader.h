@@ -0,0 +1,39 @@
+#pragma once
+
+#include "Codec.h"
+#include "FileStream.h"
+
+// .ikt files are raw pixels behind a header that describes them, so they open without asking for the size and color
+// format. All fields are little endian:
+//   0  "IKT" 0x1A
+//   4  uint16 version, readers reject newer ones
+//   6  uint16 ColorFormat
+//   8  uint64 width
+//  16  uint64 height
+//  24  uint64 stride, bytes from the start of one row to the next, at least width * get_pixelSize
+//  32  uint64 offset of the first row from the start of the file, writers align it to imageDataAlignment
+// Anything between the header and the first row is ignored, later versions can put more fields there.
+struct ImageHeader {
+    ColorFormat cf = ColorFormat::Invalid;
+    uint64_t width = 0, height = 0;
+    uint64_t stride = 0;
+    uint64_t dataOffset = 0;
+};
+static constexpr uint16_t imageHeaderVersion = 1;
+static constexpr size_t imageHeaderSize = 40;
+// The pixels start on a page, so a mapped file can hand them out without copying.
+static constexpr uint64_t imageDataAlignment = 4096;
+
+enum class HeaderStatus {
+    ok,
+    invalid,        // not an .ikt file, or its fields contradict each other
+    newerVersion,
+    truncated,      // the rows don't fit in the file
+};
+
+// The header for an image with tightly packed rows.
+ImageHeader makeImageHeader(ColorFormat cf, uint64_t width, uint64_t height);
+// Checks the header at the start of a file of fileSize bytes, data needs the first imageHeaderSize of them if it has that many.
+HeaderStatus readImageHeader(const uint8_t* data, uint64_t fileSize, ImageHeader& header);
+// Writes the header and the padding up to dataOffset, the rows follow it.
+bool writeImageHeader(OutputFile& file, const ImageHeader& header);
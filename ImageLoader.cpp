@@ -0,0 +1,34 @@
+#include "ImageLoader.h"
+
+ImageLoader::ImageLoader(Job job, std::function<void()> notify) : notify(std::move(notify)), thread(&ImageLoader::run, this, std::move(job)) {
+}
+ImageLoader::~ImageLoader() {
+    cancel();
+}
+void ImageLoader::cancel() {
+    cancelling = true;
+    wait();
+}
+void ImageLoader::wait() {
+    if (thread.joinable()) thread.join();
+}
+uint64_t ImageLoader::poll(bool& done, bool& failed) {
+    // Cleared before reading, so anything published after this gets a notification of its own
+    notified = false;
+    int current = state;
+    done = current != running;
+    failed = current == State::failed;
+    return decoded;
+}
+void ImageLoader::run(const Job& job) {
+    bool ok = job([this](uint64_t count) {
+        decoded = count;
+        post();
+        return !cancelling;
+    });
+    state = ok ? succeeded : State::failed;
+    post();
+}
+void ImageLoader::post() {
+    if (!cancelling && !notified.exchange(true)) notify();
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "Codec.h"
+#include <atomic>
+#include <functional>
+#include <thread>
+
+// Decodes an image on a thread of its own, so the window stays responsive and can show the rows that are done while
+// the rest is decoded. Nothing is locked: the decoding thread publishes how many pixels are done, and notifies the
+// window thread once for everything that happened until it polls.
+class ImageLoader {
+public:
+    // Decodes the image, telling progress as it goes and stopping when progress returns false. Returns false if the
+    // file turned out to be broken, after reporting what was decoded of it.
+    typedef std::function<bool(const DecodeProgress& progress)> Job;
+
+    // Starts job. notify is called on the decoding thread when pixels are done or the job returned, unless the news
+    // from its last call hasn't been polled yet.
+    ImageLoader(Job job, std::function<void()> notify);
+    ImageLoader(const ImageLoader&) = delete;
+    ImageLoader& operator=(const ImageLoader&) = delete;
+    // Cancels the job and waits for it.
+    ~ImageLoader();
+
+    // Stops the job at its next progress report and waits for it to return. The image is left partly decoded and
+    // notify isn't called anymore.
+    void cancel();
+    // Waits for the job to return.
+    void wait();
+    // Returns the pixels decoded from the start of the image so far. done is set once the job returned and failed
+    // if it returned false.
+    uint64_t poll(bool& done, bool& failed);
+
+private:
+    void run(const Job& job);
+    void post();
+
+    enum State { running, succeeded, failed };
+    std::function<void()> notify;
+    std::atomic<uint64_t> decoded{ 0 };
+    std::atomic<int> state{ running };
+    std::atomic<bool> cancelling{ false };
+    std::atomic<bool> notified{ false };
+    // Started last, once everything it uses exists
+    std::thread thread;
+};
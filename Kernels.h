@@ -0,0 +1,125 @@
+#pragma once
+
+#include "Codec.h"
+#include "Formats.h"
+
+#include <utility>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Resampling weights are fixed point with resampleBits fraction bits, the weights of every output pixel sum to 1.
+static constexpr int resampleBits = 14;
+// Scales a row horizontally: dst[x] = sum of src[starts[x] + k] * weights[x * taps + k] for k < taps, per channel.
+// starts[x] + taps never goes past the source row.
+typedef void(*RowResampler)(const Pixel* src, Pixel* dst, size_t width, const int32_t* starts, const int16_t* weights, size_t taps);
+// Scales vertically: dst[x] = sum of rows[k][x] * weights[k] for k < taps, per channel, for x from begin to end.
+typedef void(*ColumnResampler)(const Pixel* const* rows, const int16_t* weights, size_t taps, Pixel* dst, size_t begin, size_t end);
+// Halves two rows into one: dst[x] is the rounded average of top[2x], top[2x + 1], bottom[2x] and bottom[2x + 1].
+typedef void(*RowHalver)(const Pixel* top, const Pixel* bottom, Pixel* dst, size_t count);
+
+// SIMD implementations of the codec kernels, one table per instruction set.
+// Entries are NULL where the instruction set has nothing better than the scalar kernel.
+struct KernelTable {
+    ColorFormatDecoder decoders[static_cast<int>(ColorFormat::Invalid)];
+    ColorFormatEncoder encoders[static_cast<int>(ColorFormat::Invalid)];
+    TextParser readtxt;
+    // Returns the number of invalid characters and stores the offset of the first one in first
+    TextValidator validatetxt;
+    TextWriter writetxt;
+    RowResampler resampleRow;
+    ColumnResampler resampleColumns;
+    RowHalver halveRow;
+};
+
+// Portable fallbacks, also used by the SIMD kernels for their tails.
+size_t readtxtScalar(const char* text, uint8_t* data, size_t count);
+size_t validatetxtScalar(const char* text, size_t length, size_t* first);
+void writetxtScalar(const uint8_t* data, char* text, size_t count);
+ColorFormatDecoder get_scalarDecoder(ColorFormat cf);
+ColorFormatEncoder get_scalarEncoder(ColorFormat cf);
+void resampleRowScalar(const Pixel* src, Pixel* dst, size_t width, const int32_t* starts, const int16_t* weights, size_t taps);
+void resampleColumnsScalar(const Pixel* const* rows, const int16_t* weights, size_t taps, Pixel* dst, size_t begin, size_t end);
+void halveRowScalar(const Pixel* top, const Pixel* bottom, Pixel* dst, size_t count);
+
+// NULL when the compiler can't target the instruction set. Each table lives in a file compiled for its instruction set,
+// so it may only be requested once get_simdLevel() says the CPU supports it, and everything in those files has to be
+// static, an inline function compiled for AVX2 could otherwise be picked by the linker for the portable code.
+const KernelTable* get_ssse3Kernels();
+const KernelTable* get_avx2Kernels();
+// The tables the CPU supports from the widest down, NULL for the others. The first table with an entry wins, formats
+// and kernels without one use the scalar kernels.
+typedef const KernelTable* KernelTables[2];
+const KernelTables& get_simdKernels();
+
+// The byte layouts of 3 or 4 bytes per pixel, the only ones the shuffle based kernels handle.
+static constexpr bool isBytePixel(ColorFormat cf) {
+    return get_formatLayout(cf).channelSize == 1 && (get_formatLayout(cf).slotCount == 3 || get_formatLayout(cf).slotCount == 4);
+}
+// The float64 layouts of 4 slots, the only ones the FloatHSL kernels handle.
+static constexpr bool isFloatPixel(ColorFormat cf) {
+    return get_formatLayout(cf).channelSize == 8 && get_formatLayout(cf).slotCount == 4;
+}
+// Fills the decoders and encoders of a table from one kernel family per color model. Family<model>::decoder<cf>() and
+// encoder<cf>() return NULL for the layouts the family has nothing for.
+template <template <ColorModel> class Family, size_t... formats>
+static inline void fillFormatKernels(KernelTable& table, std::index_sequence<formats...>) {
+    const ColorFormatDecoder decoders[] = { Family<get_formatLayout(static_cast<ColorFormat>(formats)).model>::template decoder<static_cast<ColorFormat>(formats)>()... };
+    const ColorFormatEncoder encoders[] = { Family<get_formatLayout(static_cast<ColorFormat>(formats)).model>::template encoder<static_cast<ColorFormat>(formats)>()... };
+    for (size_t i = 0; i < sizeof...(formats); i++) {
+        table.decoders[i] = decoders[i];
+        table.encoders[i] = encoders[i];
+    }
+}
+
+// pshufb masks for the byte formats, repeated for both 128 bit lanes of an AVX2 register.
+// size is the bytes per pixel on the raw side, red, green and blue the offsets of the channels in it.
+struct ShuffleMask {
+    alignas(32) int8_t bytes[32];
+};
+// Raw pixels -> Pixel, 4 pixels per lane read from the start of the lane.
+static constexpr ShuffleMask decodeShuffleMask(int size, int red, int green, int blue) {
+    ShuffleMask mask{};
+    for (int j = 0; j < 32; j++) {
+        int pixel = j % 16 / 4, channel = j % 4;
+        mask.bytes[j] = static_cast<int8_t>(channel == 0 ? pixel * size + blue : channel == 1 ? pixel * size + green : channel == 2 ? pixel * size + red : -128);
+    }
+    return mask;
+}
+// Pixel -> raw pixels, 4 pixels per lane packed to the start of the lane, the rest of the lane and the padding byte are zero.
+// top is the offset the reserved byte goes to, -1 to drop it.
+static constexpr ShuffleMask encodeShuffleMask(int size, int red, int green, int blue, int top = -1) {
+    ShuffleMask mask{};
+    for (int j = 0; j < 32; j++) {
+        int pixel = j % 16 / size, channel = j % 16 % size;
+        mask.bytes[j] = static_cast<int8_t>(pixel >= 4 ? -128 : channel == red ? pixel * 4 + 2 : channel == green ? pixel * 4 + 1 : channel == blue ? pixel * 4 :
+            channel == top ? pixel * 4 + 3 : -128);
+    }
+    return mask;
+}
+// Raw pixels -> one channel per 16 bit element, the 4 pixels at the start of the lane go to elements 0-3 or 4-7 depending on half.
+static constexpr ShuffleMask channelShuffleMask(int size, int channel, int half) {
+    ShuffleMask mask{};
+    for (int j = 0; j < 32; j++) {
+        int element = j % 16 / 2;
+        mask.bytes[j] = static_cast<int8_t>(j % 2 == 0 && element / 4 == half ? element % 4 * size + channel : -128);
+    }
+    return mask;
+}
+
+// Only used on the rare masks with invalid characters, so the instruction sets don't need POPCNT.
+static inline int popcount32(uint32_t x) {
+    x = x - ((x >> 1) & 0x55555555u);
+    x = (x & 0x33333333u) + ((x >> 2) & 0x33333333u);
+    return static_cast<int>((((x + (x >> 4)) & 0x0F0F0F0Fu) * 0x01010101u) >> 24);
+}
+static inline int countTrailingZeros(uint32_t x) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, x);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctz(x);
+#endif
+}
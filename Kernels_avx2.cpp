@@ -0,0 +1,499 @@
+#include "Kernels.h"
+
+#if defined(__AVX2__)
+#include <cstring>
+#include <immintrin.h>
+
+// Same byte permutations as the SSSE3 kernels, vpshufb shuffles each 128 bit lane separately so 8 pixels go per instruction.
+static inline __m256i loadLanes(const uint8_t* low, const uint8_t* high) {
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(low))), _mm_loadu_si128(reinterpret_cast<const __m128i*>(high)), 1);
+}
+template <ColorFormat cf>
+static inline __m256i decodeBytes(__m256i x, __m256i shuffle, __m256i black) {
+    __m256i pixels = _mm256_shuffle_epi8(x, shuffle);
+    if (get_formatLayout(cf).model != ColorModel::RGB) pixels = _mm256_xor_si256(pixels, _mm256_set1_epi32(0x00FFFFFF));
+    if (get_formatLayout(cf).model == ColorModel::CMYK) pixels = _mm256_sub_epi8(pixels, _mm256_shuffle_epi8(x, black));
+    return pixels;
+}
+template <ColorFormat cf>
+static void decodeShuffle(const uint8_t* src, Pixel* dst, size_t n) {
+    static constexpr int size = get_formatSize(cf);
+    static constexpr ShuffleMask mask = decodeShuffleMask(size, channelOffset(cf, 0), channelOffset(cf, 1), channelOffset(cf, 2));
+    static constexpr ShuffleMask blackMask = decodeShuffleMask(size, channelOffset(cf, 3), channelOffset(cf, 3), channelOffset(cf, 3));
+    const __m256i shuffle = _mm256_load_si256(reinterpret_cast<const __m256i*>(mask.bytes));
+    const __m256i black = _mm256_load_si256(reinterpret_cast<const __m256i*>(blackMask.bytes));
+    __m256i* out = reinterpret_cast<__m256i*>(dst);
+    size_t i = 0;
+    if (size == 4) {
+        for (; i + 32 <= n; i += 32, src += 128, out += 4) {
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+            __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 32));
+            __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 64));
+            __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 96));
+            _mm256_storeu_si256(out, decodeBytes<cf>(a, shuffle, black));
+            _mm256_storeu_si256(out + 1, decodeBytes<cf>(b, shuffle, black));
+            _mm256_storeu_si256(out + 2, decodeBytes<cf>(c, shuffle, black));
+            _mm256_storeu_si256(out + 3, decodeBytes<cf>(d, shuffle, black));
+        }
+    }
+    else {
+        // Every lane covers 4 pixels and 4 bytes of the next one, the last lane needs 2 pixels of headroom.
+        for (; i + 34 <= n; i += 32, src += 96, out += 4) {
+            __m256i a = loadLanes(src, src + 12);
+            __m256i b = loadLanes(src + 24, src + 36);
+            __m256i c = loadLanes(src + 48, src + 60);
+            __m256i d = loadLanes(src + 72, src + 84);
+            _mm256_storeu_si256(out, decodeBytes<cf>(a, shuffle, black));
+            _mm256_storeu_si256(out + 1, decodeBytes<cf>(b, shuffle, black));
+            _mm256_storeu_si256(out + 2, decodeBytes<cf>(c, shuffle, black));
+            _mm256_storeu_si256(out + 3, decodeBytes<cf>(d, shuffle, black));
+        }
+    }
+    get_scalarDecoder(cf)(src, dst + i, n - i);
+}
+// Packs 16 pixels worth of 32 bit words with shuffle and stores them as size bytes each.
+template <int size>
+static inline void storeShuffled(uint8_t* dst, __m256i x, __m256i y, __m256i shuffle) {
+    x = _mm256_shuffle_epi8(x, shuffle);
+    y = _mm256_shuffle_epi8(y, shuffle);
+    if (size == 4) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), x);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 32), y);
+        return;
+    }
+    // 12 bytes per lane, stitched into 3 full 128 bit registers
+    __m128i a = _mm256_castsi256_si128(x), b = _mm256_extracti128_si256(x, 1);
+    __m128i c = _mm256_castsi256_si128(y), d = _mm256_extracti128_si256(y, 1);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_or_si128(a, _mm_slli_si128(b, 12)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16), _mm_or_si128(_mm_srli_si128(b, 4), _mm_slli_si128(c, 8)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 32), _mm_or_si128(_mm_srli_si128(c, 8), _mm_slli_si128(d, 4)));
+}
+// Same as the SSSE3 HSL and HSV kernels with 16 pixels per register.
+static inline __m256i divide255(__m256i x) {
+    return _mm256_srli_epi16(_mm256_mulhi_epu16(x, _mm256_set1_epi16(static_cast<short>(0x8081))), 7);
+}
+static inline __m256i divide42(__m256i x) {
+    return _mm256_srli_epi16(_mm256_mulhi_epu16(x, _mm256_set1_epi16(3121)), 1);
+}
+static inline __m256i lessThan(__m256i a, int b) {
+    return _mm256_cmpgt_epi16(_mm256_set1_epi16(static_cast<short>(b)), a);
+}
+// Lane 0 gets pixels 0-3 and 8-11, lane 1 pixels 4-7 and 12-15, storePixels puts them back in order.
+template <ColorFormat cf>
+static inline void loadChannels(const uint8_t* src, __m256i& c0, __m256i& c1, __m256i& c2) {
+    static constexpr int size = get_formatSize(cf);
+    static constexpr ShuffleMask masks[6] = { channelShuffleMask(size, channelOffset(cf, 0), 0), channelShuffleMask(size, channelOffset(cf, 1), 0),
+        channelShuffleMask(size, channelOffset(cf, 2), 0), channelShuffleMask(size, channelOffset(cf, 0), 1), channelShuffleMask(size, channelOffset(cf, 1), 1),
+        channelShuffleMask(size, channelOffset(cf, 2), 1) };
+    __m256i low = loadLanes(src, src + 4 * size), high = loadLanes(src + 8 * size, src + 12 * size);
+    c0 = _mm256_or_si256(_mm256_shuffle_epi8(low, _mm256_load_si256(reinterpret_cast<const __m256i*>(masks[0].bytes))), _mm256_shuffle_epi8(high, _mm256_load_si256(reinterpret_cast<const __m256i*>(masks[3].bytes))));
+    c1 = _mm256_or_si256(_mm256_shuffle_epi8(low, _mm256_load_si256(reinterpret_cast<const __m256i*>(masks[1].bytes))), _mm256_shuffle_epi8(high, _mm256_load_si256(reinterpret_cast<const __m256i*>(masks[4].bytes))));
+    c2 = _mm256_or_si256(_mm256_shuffle_epi8(low, _mm256_load_si256(reinterpret_cast<const __m256i*>(masks[2].bytes))), _mm256_shuffle_epi8(high, _mm256_load_si256(reinterpret_cast<const __m256i*>(masks[5].bytes))));
+}
+static inline void storePixels(Pixel* dst, __m256i red, __m256i green, __m256i blue) {
+    __m256i blueGreen = _mm256_or_si256(blue, _mm256_slli_epi16(green, 8));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), _mm256_unpacklo_epi16(blueGreen, red));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 8), _mm256_unpackhi_epi16(blueGreen, red));
+}
+static inline __m256i hueToRgb(__m256i p, __m256i q, __m256i t) {
+    const __m256i d = _mm256_sub_epi16(q, p);
+    __m256i rising = _mm256_add_epi16(p, divide42(_mm256_mullo_epi16(t, d)));
+    __m256i falling = _mm256_add_epi16(p, divide42(_mm256_mullo_epi16(_mm256_sub_epi16(_mm256_set1_epi16(170), t), d)));
+    __m256i out = _mm256_blendv_epi8(p, falling, lessThan(t, 170));
+    out = _mm256_blendv_epi8(out, q, lessThan(t, 128));
+    return _mm256_blendv_epi8(out, rising, lessThan(t, 42));
+}
+static inline __m256i scale65025(__m256i v, __m256i w) {
+    __m256i w1 = divide255(w), w0 = _mm256_sub_epi16(w, _mm256_mullo_epi16(w1, _mm256_set1_epi16(255)));
+    return divide255(_mm256_add_epi16(_mm256_mullo_epi16(v, w1), divide255(_mm256_mullo_epi16(v, w0))));
+}
+template <ColorFormat cf>
+static void decodeHSL(const uint8_t* src, Pixel* dst, size_t n) {
+    const __m256i byte = _mm256_set1_epi16(0xFF), zero = _mm256_setzero_si256();
+    static constexpr int size = get_formatSize(cf);
+    size_t i = 0;
+    for (; i + (size == 3 ? 18 : 16) <= n; i += 16, src += 16 * size) {
+        __m256i h, s, l;
+        loadChannels<cf>(src, h, s, l);
+        __m256i ls = divide255(_mm256_mullo_epi16(l, s));
+        __m256i q = _mm256_blendv_epi8(_mm256_sub_epi16(_mm256_add_epi16(l, s), ls), _mm256_add_epi16(l, ls), lessThan(l, 128));
+        __m256i p = _mm256_sub_epi16(_mm256_add_epi16(l, l), q);
+        __m256i tRed = _mm256_and_si256(_mm256_add_epi16(h, _mm256_set1_epi16(87)), byte), tBlue = _mm256_and_si256(_mm256_sub_epi16(h, _mm256_set1_epi16(87)), byte);
+        __m256i gray = _mm256_cmpeq_epi16(s, zero);
+        storePixels(dst + i, _mm256_blendv_epi8(hueToRgb(p, q, tRed), l, gray), _mm256_blendv_epi8(hueToRgb(p, q, h), l, gray), _mm256_blendv_epi8(hueToRgb(p, q, tBlue), l, gray));
+    }
+    get_scalarDecoder(cf)(src, dst + i, n - i);
+}
+template <ColorFormat cf>
+static void decodeHSV(const uint8_t* src, Pixel* dst, size_t n) {
+    const __m256i c255 = _mm256_set1_epi16(255), c65025 = _mm256_set1_epi16(static_cast<short>(65025));
+    static constexpr int size = get_formatSize(cf);
+    size_t i = 0;
+    for (; i + (size == 3 ? 18 : 16) <= n; i += 16, src += 16 * size) {
+        __m256i h, s, v;
+        loadChannels<cf>(src, h, s, v);
+        __m256i sector = divide42(h);
+        __m256i ff = _mm256_mullo_epi16(_mm256_sub_epi16(h, _mm256_mullo_epi16(sector, _mm256_set1_epi16(42))), _mm256_set1_epi16(6));
+        __m256i p = divide255(_mm256_mullo_epi16(v, _mm256_sub_epi16(c255, s)));
+        __m256i q = scale65025(v, _mm256_sub_epi16(c65025, _mm256_mullo_epi16(s, ff)));
+        __m256i t = scale65025(v, _mm256_sub_epi16(c65025, _mm256_mullo_epi16(s, _mm256_sub_epi16(c255, ff))));
+        __m256i s0 = _mm256_cmpeq_epi16(sector, _mm256_setzero_si256()), s1 = _mm256_cmpeq_epi16(sector, _mm256_set1_epi16(1));
+        __m256i s2 = _mm256_cmpeq_epi16(sector, _mm256_set1_epi16(2)), s3 = _mm256_cmpeq_epi16(sector, _mm256_set1_epi16(3));
+        __m256i s4 = _mm256_cmpeq_epi16(sector, _mm256_set1_epi16(4));
+        __m256i red = _mm256_blendv_epi8(_mm256_blendv_epi8(_mm256_blendv_epi8(v, t, s4), p, _mm256_or_si256(s2, s3)), q, s1);
+        __m256i green = _mm256_blendv_epi8(_mm256_blendv_epi8(_mm256_blendv_epi8(p, q, s3), v, _mm256_or_si256(s1, s2)), t, s0);
+        __m256i blue = _mm256_blendv_epi8(_mm256_blendv_epi8(_mm256_blendv_epi8(q, v, _mm256_or_si256(s3, s4)), t, s2), p, _mm256_or_si256(s0, s1));
+        __m256i gray = _mm256_cmpeq_epi16(s, _mm256_setzero_si256());
+        storePixels(dst + i, _mm256_blendv_epi8(red, v, gray), _mm256_blendv_epi8(green, v, gray), _mm256_blendv_epi8(blue, v, gray));
+    }
+    get_scalarDecoder(cf)(src, dst + i, n - i);
+}
+// Same as the SSSE3 HSL, HSV and CMYK encoders with 8 pixels per register.
+static inline __m256i truncateDivide(__m256 x, __m256 y) {
+    return _mm256_cvttps_epi32(_mm256_div_ps(x, y));
+}
+static inline void unpackPixels(__m256i pixels, __m256& red, __m256& green, __m256& blue) {
+    const __m256i byte = _mm256_set1_epi32(0xFF);
+    blue = _mm256_cvtepi32_ps(_mm256_and_si256(pixels, byte));
+    green = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(pixels, 8), byte));
+    red = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(pixels, 16), byte));
+}
+static inline __m256i encodeHue(__m256 red, __m256 green, __m256 blue, __m256 max, __m256 d) {
+    __m256 isRed = _mm256_cmp_ps(max, red, _CMP_EQ_OQ), isGreen = _mm256_andnot_ps(isRed, _mm256_cmp_ps(max, green, _CMP_EQ_OQ));
+    __m256 difference = _mm256_blendv_ps(_mm256_blendv_ps(_mm256_sub_ps(red, green), _mm256_sub_ps(blue, red), isGreen), _mm256_sub_ps(green, blue), isRed);
+    __m256i offset = _mm256_blendv_epi8(_mm256_blendv_epi8(_mm256_set1_epi32(168), _mm256_set1_epi32(84), _mm256_castps_si256(isGreen)), _mm256_setzero_si256(), _mm256_castps_si256(isRed));
+    __m256i h = _mm256_add_epi32(truncateDivide(_mm256_mul_ps(difference, _mm256_set1_ps(42.0f)), d), offset);
+    return _mm256_and_si256(h, _mm256_set1_epi32(0xFF));
+}
+static inline __m256i hslWords(__m256i pixels) {
+    __m256 red, green, blue;
+    unpackPixels(pixels, red, green, blue);
+    __m256 max = _mm256_max_ps(_mm256_max_ps(red, green), blue), min = _mm256_min_ps(_mm256_min_ps(red, green), blue);
+    __m256 d = _mm256_sub_ps(max, min), sum = _mm256_add_ps(max, min);
+    __m256i l = _mm256_cvttps_epi32(_mm256_mul_ps(sum, _mm256_set1_ps(0.5f)));
+    __m256 denominator = _mm256_blendv_ps(sum, _mm256_sub_ps(_mm256_set1_ps(510.0f), sum), _mm256_cmp_ps(sum, _mm256_set1_ps(255.0f), _CMP_GT_OQ));
+    __m256i s = truncateDivide(_mm256_mul_ps(d, _mm256_set1_ps(255.0f)), denominator);
+    __m256i h = encodeHue(red, green, blue, max, d);
+    __m256i gray = _mm256_castps_si256(_mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_EQ_OQ));
+    return _mm256_or_si256(_mm256_andnot_si256(gray, _mm256_or_si256(_mm256_slli_epi32(h, 16), _mm256_slli_epi32(s, 8))), l);
+}
+static inline __m256i hsvWords(__m256i pixels) {
+    __m256 red, green, blue;
+    unpackPixels(pixels, red, green, blue);
+    __m256 max = _mm256_max_ps(_mm256_max_ps(red, green), blue), min = _mm256_min_ps(_mm256_min_ps(red, green), blue);
+    __m256 d = _mm256_sub_ps(max, min);
+    __m256i s = truncateDivide(_mm256_mul_ps(d, _mm256_set1_ps(255.0f)), max);
+    __m256i h = encodeHue(red, green, blue, max, d);
+    __m256i gray = _mm256_castps_si256(_mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_EQ_OQ));
+    return _mm256_or_si256(_mm256_andnot_si256(gray, _mm256_or_si256(_mm256_slli_epi32(h, 16), _mm256_slli_epi32(s, 8))), _mm256_cvttps_epi32(max));
+}
+static inline __m256i rgbWords(__m256i pixels) {
+    return pixels;
+}
+static inline __m256i cmyWords(__m256i pixels) {
+    return _mm256_xor_si256(pixels, _mm256_set1_epi32(0x00FFFFFF));
+}
+static inline __m256i cmykWords(__m256i pixels) {
+    const __m256i broadcast = _mm256_setr_epi8(0, 0, 0, 0, 4, 4, 4, 4, 8, 8, 8, 8, 12, 12, 12, 12, 0, 0, 0, 0, 4, 4, 4, 4, 8, 8, 8, 8, 12, 12, 12, 12);
+    const __m256i invert = _mm256_set1_epi32(0x00FFFFFF);
+    __m256i cmy = _mm256_xor_si256(pixels, invert);
+    __m256i k = _mm256_min_epu8(_mm256_min_epu8(cmy, _mm256_srli_epi32(cmy, 8)), _mm256_srli_epi32(cmy, 16));
+    k = _mm256_shuffle_epi8(k, broadcast);
+    return _mm256_blendv_epi8(k, _mm256_sub_epi8(cmy, k), invert);
+}
+template <ColorFormat cf, __m256i(*words)(__m256i)>
+static void encodeWords(const Pixel* src, uint8_t* dst, size_t n) {
+    static constexpr int size = get_formatSize(cf);
+    static constexpr ShuffleMask mask = encodeShuffleMask(size, channelOffset(cf, 0), channelOffset(cf, 1), channelOffset(cf, 2), channelOffset(cf, 3));
+    const __m256i shuffle = _mm256_load_si256(reinterpret_cast<const __m256i*>(mask.bytes));
+    const __m256i* in = reinterpret_cast<const __m256i*>(src);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16, in += 2, dst += 16 * size)
+        storeShuffled<size>(dst, words(_mm256_loadu_si256(in)), words(_mm256_loadu_si256(in + 1)), shuffle);
+    get_scalarEncoder(cf)(src + i, dst, n - i);
+}
+// Same as the SSSE3 FloatHSL kernels with 4 pixels per iteration.
+static inline __m256d pythonHueToRgb(__m256d p, __m256d q, __m256d t) {
+    const __m256d circle = _mm256_set1_pd(360.0), sixty = _mm256_set1_pd(60.0), scale = _mm256_set1_pd(255.0);
+    t = _mm256_add_pd(t, _mm256_and_pd(_mm256_cmp_pd(t, _mm256_setzero_pd(), _CMP_LT_OQ), circle));
+    t = _mm256_sub_pd(t, _mm256_and_pd(_mm256_cmp_pd(t, circle, _CMP_GT_OQ), circle));
+    __m256d difference = _mm256_sub_pd(q, p);
+    __m256d rising = _mm256_mul_pd(_mm256_add_pd(p, _mm256_div_pd(_mm256_mul_pd(difference, t), sixty)), scale);
+    __m256d falling = _mm256_mul_pd(_mm256_add_pd(p, _mm256_div_pd(_mm256_mul_pd(difference, _mm256_sub_pd(_mm256_set1_pd(240.0), t)), sixty)), scale);
+    __m256d x = _mm256_blendv_pd(_mm256_mul_pd(p, scale), falling, _mm256_cmp_pd(t, _mm256_set1_pd(240.0), _CMP_LT_OQ));
+    x = _mm256_blendv_pd(x, _mm256_mul_pd(q, scale), _mm256_cmp_pd(t, _mm256_set1_pd(180.0), _CMP_LT_OQ));
+    return _mm256_blendv_pd(x, rising, _mm256_cmp_pd(t, sixty, _CMP_LT_OQ));
+}
+static inline __m128i pythonToBytes(__m256d x) {
+    return _mm256_cvttpd_epi32(_mm256_max_pd(_mm256_min_pd(x, _mm256_set1_pd(255.0)), _mm256_setzero_pd()));
+}
+template <ColorFormat cf>
+static void decodeFloatHSL(const uint8_t* src, Pixel* dst, size_t n) {
+    const __m256d scale = _mm256_set1_pd(255.0), third = _mm256_set1_pd(120.0);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4, src += 128) {
+        const double* in = reinterpret_cast<const double*>(src);
+        __m256d a = _mm256_loadu_pd(in), b = _mm256_loadu_pd(in + 4), c = _mm256_loadu_pd(in + 8), d = _mm256_loadu_pd(in + 12);
+        // Slots 0 and 2 / 1 and 3 of pixels 0 and 1, the same for 2 and 3, then joined by lane
+        __m256d even01 = _mm256_unpacklo_pd(a, b), odd01 = _mm256_unpackhi_pd(a, b), even23 = _mm256_unpacklo_pd(c, d), odd23 = _mm256_unpackhi_pd(c, d);
+        const __m256d slots[4] = { _mm256_permute2f128_pd(even01, even23, 0x20), _mm256_permute2f128_pd(odd01, odd23, 0x20),
+            _mm256_permute2f128_pd(even01, even23, 0x31), _mm256_permute2f128_pd(odd01, odd23, 0x31) };
+        __m256d h = slots[get_formatLayout(cf).slots[0]], s = slots[get_formatLayout(cf).slots[1]], l = slots[get_formatLayout(cf).slots[2]];
+        __m256d q = _mm256_blendv_pd(_mm256_sub_pd(_mm256_add_pd(l, s), _mm256_mul_pd(l, s)), _mm256_mul_pd(l, _mm256_add_pd(_mm256_set1_pd(1.0), s)),
+            _mm256_cmp_pd(l, _mm256_set1_pd(0.5), _CMP_LT_OQ));
+        __m256d p = _mm256_sub_pd(_mm256_mul_pd(_mm256_set1_pd(2.0), l), q);
+        __m256d gray = _mm256_cmp_pd(s, _mm256_setzero_pd(), _CMP_EQ_OQ), lightness = _mm256_mul_pd(l, scale);
+        __m128i red = pythonToBytes(_mm256_blendv_pd(pythonHueToRgb(p, q, _mm256_add_pd(h, third)), lightness, gray));
+        __m128i green = pythonToBytes(_mm256_blendv_pd(pythonHueToRgb(p, q, h), lightness, gray));
+        __m128i blue = pythonToBytes(_mm256_blendv_pd(pythonHueToRgb(p, q, _mm256_sub_pd(h, third)), lightness, gray));
+        __m128i pixels = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(red, 16), _mm_slli_epi32(green, 8)), blue);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), pixels);
+    }
+    get_scalarDecoder(cf)(src, dst + i, n - i);
+}
+template <ColorFormat cf>
+static void encodeFloatHSL(const Pixel* src, uint8_t* dst, size_t n) {
+    const __m128i byte = _mm_set1_epi32(0xFF);
+    const __m256d zero = _mm256_setzero_pd(), sixty = _mm256_set1_pd(60.0);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4, dst += 128) {
+        __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m256d blue = _mm256_cvtepi32_pd(_mm_and_si128(pixels, byte));
+        __m256d green = _mm256_cvtepi32_pd(_mm_and_si128(_mm_srli_epi32(pixels, 8), byte));
+        __m256d red = _mm256_cvtepi32_pd(_mm_and_si128(_mm_srli_epi32(pixels, 16), byte));
+        __m256d max = _mm256_max_pd(_mm256_max_pd(red, green), blue), min = _mm256_min_pd(_mm256_min_pd(red, green), blue);
+        __m256d l = _mm256_add_pd(max, min), d = _mm256_sub_pd(max, min);
+        __m256d s = _mm256_blendv_pd(_mm256_div_pd(d, l), _mm256_div_pd(d, _mm256_sub_pd(_mm256_set1_pd(510.0), l)), _mm256_cmp_pd(l, _mm256_set1_pd(255.0), _CMP_GT_OQ));
+        __m256d hr = _mm256_add_pd(_mm256_div_pd(_mm256_mul_pd(_mm256_sub_pd(green, blue), sixty), d),
+            _mm256_and_pd(_mm256_cmp_pd(green, blue, _CMP_LT_OQ), _mm256_set1_pd(360.0)));
+        __m256d hg = _mm256_add_pd(_mm256_div_pd(_mm256_mul_pd(_mm256_sub_pd(blue, red), sixty), d), _mm256_set1_pd(120.0));
+        __m256d hb = _mm256_add_pd(_mm256_div_pd(_mm256_mul_pd(_mm256_sub_pd(red, green), sixty), d), _mm256_set1_pd(240.0));
+        __m256d h = _mm256_blendv_pd(_mm256_blendv_pd(hb, hg, _mm256_cmp_pd(max, green, _CMP_EQ_OQ)), hr, _mm256_cmp_pd(max, red, _CMP_EQ_OQ));
+        __m256d gray = _mm256_cmp_pd(max, min, _CMP_EQ_OQ);
+        h = _mm256_andnot_pd(gray, h);
+        s = _mm256_andnot_pd(gray, s);
+        l = _mm256_div_pd(l, _mm256_set1_pd(512.0));
+        const __m256d channels[4] = { h, s, l, zero };
+        __m256d slots[4];
+        for (int slot = 0; slot < 4; slot++)
+            slots[slot] = channels[slotChannel(cf, slot) < 0 ? 3 : slotChannel(cf, slot)];
+        // Slots 0 and 1 of pixels 0 and 2 / 1 and 3, the same for slots 2 and 3, then one pixel per register
+        __m256d low02 = _mm256_unpacklo_pd(slots[0], slots[1]), low13 = _mm256_unpackhi_pd(slots[0], slots[1]);
+        __m256d high02 = _mm256_unpacklo_pd(slots[2], slots[3]), high13 = _mm256_unpackhi_pd(slots[2], slots[3]);
+        double* out = reinterpret_cast<double*>(dst);
+        _mm256_storeu_pd(out, _mm256_permute2f128_pd(low02, high02, 0x20));
+        _mm256_storeu_pd(out + 4, _mm256_permute2f128_pd(low13, high13, 0x20));
+        _mm256_storeu_pd(out + 8, _mm256_permute2f128_pd(low02, high02, 0x31));
+        _mm256_storeu_pd(out + 12, _mm256_permute2f128_pd(low13, high13, 0x31));
+    }
+    get_scalarEncoder(cf)(src + i, dst, n - i);
+}
+// Same as the SSSE3 parser with 32 characters per register.
+static size_t parseText(const char* text, uint8_t* data, size_t count) {
+    const __m256i zero = _mm256_set1_epi8('0'), invalid = _mm256_set1_epi8(static_cast<char>(0xFE));
+    const __m256i reverse = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8, text += 64) {
+        __m256i a = _mm256_sub_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(text)), zero);
+        __m256i b = _mm256_sub_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + 32)), zero);
+        if (!_mm256_testz_si256(_mm256_or_si256(a, b), invalid)) break;
+        uint64_t bits = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_slli_epi16(_mm256_shuffle_epi8(a, reverse), 7)))
+            | static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_slli_epi16(_mm256_shuffle_epi8(b, reverse), 7)))) << 32;
+        memcpy(data + i, &bits, 8);
+    }
+    return i + readtxtScalar(text, data + i, count - i);
+}
+static size_t validateText(const char* text, size_t length, size_t* first) {
+    const __m256i zero = _mm256_set1_epi8('0'), invalid = _mm256_set1_epi8(static_cast<char>(0xFE));
+    size_t count = 0, i = 0;
+    for (; i + 64 <= length; i += 64) {
+        __m256i a = _mm256_and_si256(_mm256_sub_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i)), zero), invalid);
+        __m256i b = _mm256_and_si256(_mm256_sub_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i + 32)), zero), invalid);
+        if (_mm256_testz_si256(_mm256_or_si256(a, b), _mm256_or_si256(a, b))) continue;
+        uint32_t badA = ~static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, _mm256_setzero_si256())));
+        uint32_t badB = ~static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(b, _mm256_setzero_si256())));
+        if (count == 0) *first = i + (badA != 0 ? countTrailingZeros(badA) : 32 + countTrailingZeros(badB));
+        count += popcount32(badA) + popcount32(badB);
+    }
+    size_t tailFirst = 0;
+    size_t tailCount = validatetxtScalar(text + i, length - i, &tailFirst);
+    if (tailCount != 0 && count == 0) *first = i + tailFirst;
+    return count + tailCount;
+}
+// Same as the SSSE3 writer with 4 bytes per register, bytes 0 and 1 go to the low lane and 2 and 3 to the high one.
+static void writeText(const uint8_t* data, char* text, size_t count) {
+    const __m256i zero = _mm256_set1_epi8('0');
+    const __m256i spread = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    const __m256i bits = _mm256_setr_epi8(-128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16, 8, 4, 2, 1);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8, text += 64) {
+        uint32_t low, high;
+        memcpy(&low, data + i, 4);
+        memcpy(&high, data + i + 4, 4);
+        __m256i a = _mm256_shuffle_epi8(_mm256_set1_epi32(static_cast<int>(low)), spread);
+        __m256i b = _mm256_shuffle_epi8(_mm256_set1_epi32(static_cast<int>(high)), spread);
+        a = _mm256_sub_epi8(zero, _mm256_cmpeq_epi8(_mm256_and_si256(a, bits), bits));
+        b = _mm256_sub_epi8(zero, _mm256_cmpeq_epi8(_mm256_and_si256(b, bits), bits));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(text), a);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(text + 32), b);
+    }
+    writetxtScalar(data + i, text, count - i);
+}
+
+// The kernels above for every layout they handle, Gray has none. Kept out of the global namespace like everything
+// else here, the other kernel files define their own.
+namespace {
+template <ColorModel model>
+struct ModelKernels {
+    template <ColorFormat cf>
+    static ColorFormatDecoder decoder() { return NULL; }
+    template <ColorFormat cf>
+    static ColorFormatEncoder encoder() { return NULL; }
+};
+template <>
+struct ModelKernels<ColorModel::RGB> {
+    template <ColorFormat cf>
+    static ColorFormatDecoder decoder() { return isBytePixel(cf) ? decodeShuffle<cf> : NULL; }
+    template <ColorFormat cf>
+    static ColorFormatEncoder encoder() { return isBytePixel(cf) ? encodeWords<cf, rgbWords> : NULL; }
+};
+template <>
+struct ModelKernels<ColorModel::CMY> {
+    template <ColorFormat cf>
+    static ColorFormatDecoder decoder() { return isBytePixel(cf) ? decodeShuffle<cf> : NULL; }
+    template <ColorFormat cf>
+    static ColorFormatEncoder encoder() { return isBytePixel(cf) ? encodeWords<cf, cmyWords> : NULL; }
+};
+template <>
+struct ModelKernels<ColorModel::CMYK> {
+    template <ColorFormat cf>
+    static ColorFormatDecoder decoder() { return isBytePixel(cf) ? decodeShuffle<cf> : NULL; }
+    template <ColorFormat cf>
+    static ColorFormatEncoder encoder() { return isBytePixel(cf) ? encodeWords<cf, cmykWords> : NULL; }
+};
+template <>
+struct ModelKernels<ColorModel::HSL> {
+    template <ColorFormat cf>
+    static ColorFormatDecoder decoder() { return isBytePixel(cf) ? decodeHSL<cf> : NULL; }
+    template <ColorFormat cf>
+    static ColorFormatEncoder encoder() { return isBytePixel(cf) ? encodeWords<cf, hslWords> : NULL; }
+};
+template <>
+struct ModelKernels<ColorModel::HSV> {
+    template <ColorFormat cf>
+    static ColorFormatDecoder decoder() { return isBytePixel(cf) ? decodeHSV<cf> : NULL; }
+    template <ColorFormat cf>
+    static ColorFormatEncoder encoder() { return isBytePixel(cf) ? encodeWords<cf, hsvWords> : NULL; }
+};
+template <>
+struct ModelKernels<ColorModel::FloatHSL> {
+    template <ColorFormat cf>
+    static ColorFormatDecoder decoder() { return isFloatPixel(cf) ? decodeFloatHSL<cf> : NULL; }
+    template <ColorFormat cf>
+    static ColorFormatEncoder encoder() { return isFloatPixel(cf) ? encodeFloatHSL<cf> : NULL; }
+};
+}
+
+// The resamplers of the SSSE3 kernels over both lanes: the horizontal one takes 8 taps per step and adds the lanes up
+// at the end, the vertical one does 8 pixels per step.
+static inline __m256i weightPair(int16_t first, int16_t second) {
+    return _mm256_set1_epi32(static_cast<int32_t>(static_cast<uint16_t>(first) | static_cast<uint32_t>(static_cast<uint16_t>(second)) << 16));
+}
+static inline __m256i weightPairs(const int16_t* weights) {
+    // Taps 0 and 1 in the low lane, 4 and 5 in the high one
+    return _mm256_setr_epi16(weights[0], weights[1], weights[0], weights[1], weights[0], weights[1], weights[0], weights[1],
+        weights[4], weights[5], weights[4], weights[5], weights[4], weights[5], weights[4], weights[5]);
+}
+static void resampleRow(const Pixel* src, Pixel* dst, size_t width, const int32_t* starts, const int16_t* weights, size_t taps) {
+    const __m256i pairs = _mm256_setr_epi8(0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13, 10, 14, 11, 15, 0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13, 10, 14, 11, 15);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m128i pairs128 = _mm256_castsi256_si128(pairs);
+    const __m128i zero128 = _mm_setzero_si128();
+    for (size_t x = 0; x < width; x++, weights += taps) {
+        const Pixel* in = src + starts[x];
+        __m256i wide = _mm256_setzero_si256();
+        size_t k = 0;
+        for (; k + 8 <= taps; k += 8) {
+            __m256i pixels = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + k)), pairs);
+            wide = _mm256_add_epi32(wide, _mm256_madd_epi16(_mm256_unpacklo_epi8(pixels, zero), weightPairs(weights + k)));
+            wide = _mm256_add_epi32(wide, _mm256_madd_epi16(_mm256_unpackhi_epi8(pixels, zero), weightPairs(weights + k + 2)));
+        }
+        __m128i sum = _mm_add_epi32(_mm_add_epi32(_mm256_castsi256_si128(wide), _mm256_extracti128_si256(wide, 1)), _mm_set1_epi32(1 << (resampleBits - 1)));
+        for (; k + 2 <= taps; k += 2) {
+            __m128i pixels = _mm_shuffle_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in + k)), pairs128);
+            __m128i weight = _mm_set1_epi32(static_cast<int32_t>(static_cast<uint16_t>(weights[k]) | static_cast<uint32_t>(static_cast<uint16_t>(weights[k + 1])) << 16));
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_unpacklo_epi8(pixels, zero128), weight));
+        }
+        if (k < taps) {
+            int32_t value;
+            memcpy(&value, in + k, sizeof(value));
+            __m128i pixel = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(value), zero128), zero128);
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(pixel, _mm_set1_epi32(static_cast<uint16_t>(weights[k]))));
+        }
+        __m128i packed = _mm_packs_epi32(_mm_srai_epi32(sum, resampleBits), _mm_srai_epi32(sum, resampleBits));
+        *reinterpret_cast<int32_t*>(dst + x) = _mm_cvtsi128_si32(_mm_packus_epi16(packed, packed));
+    }
+}
+static void resampleColumns(const Pixel* const* rows, const int16_t* weights, size_t taps, Pixel* dst, size_t begin, size_t end) {
+    const __m256i zero = _mm256_setzero_si256();
+    size_t x = begin;
+    for (; x + 8 <= end; x += 8) {
+        __m256i sums[4];
+        for (__m256i& sum : sums) sum = _mm256_set1_epi32(1 << (resampleBits - 1));
+        for (size_t k = 0; k < taps; k += 2) {
+            // Odd tap counts pair the last row with zeros
+            __m256i first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[k] + x));
+            __m256i second = k + 1 < taps ? _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[k + 1] + x)) : zero;
+            __m256i weight = weightPair(weights[k], k + 1 < taps ? weights[k + 1] : 0);
+            __m256i low = _mm256_unpacklo_epi8(first, second), high = _mm256_unpackhi_epi8(first, second);
+            sums[0] = _mm256_add_epi32(sums[0], _mm256_madd_epi16(_mm256_unpacklo_epi8(low, zero), weight));
+            sums[1] = _mm256_add_epi32(sums[1], _mm256_madd_epi16(_mm256_unpackhi_epi8(low, zero), weight));
+            sums[2] = _mm256_add_epi32(sums[2], _mm256_madd_epi16(_mm256_unpacklo_epi8(high, zero), weight));
+            sums[3] = _mm256_add_epi32(sums[3], _mm256_madd_epi16(_mm256_unpackhi_epi8(high, zero), weight));
+        }
+        // Unpacking and packing both stay inside the lanes, so the pixels come out in order
+        __m256i low = _mm256_packs_epi32(_mm256_srai_epi32(sums[0], resampleBits), _mm256_srai_epi32(sums[1], resampleBits));
+        __m256i high = _mm256_packs_epi32(_mm256_srai_epi32(sums[2], resampleBits), _mm256_srai_epi32(sums[3], resampleBits));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x), _mm256_packus_epi16(low, high));
+    }
+    resampleColumnsScalar(rows, weights, taps, dst, x, end);
+}
+// The SSSE3 halver over both lanes. Each lane packs two pixels of either half, a final permute puts them in order.
+static void halveRow(const Pixel* top, const Pixel* bottom, Pixel* dst, size_t count) {
+    const __m256i zero = _mm256_setzero_si256(), two = _mm256_set1_epi16(2);
+    size_t x = 0;
+    for (; x + 8 <= count; x += 8) {
+        __m256i sums[2];
+        for (int i = 0; i < 2; i++) {
+            __m256i upper = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(top + 2 * x + 8 * i));
+            __m256i lower = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bottom + 2 * x + 8 * i));
+            __m256i low = _mm256_add_epi16(_mm256_unpacklo_epi8(upper, zero), _mm256_unpacklo_epi8(lower, zero));
+            __m256i high = _mm256_add_epi16(_mm256_unpackhi_epi8(upper, zero), _mm256_unpackhi_epi8(lower, zero));
+            __m256i sum = _mm256_add_epi16(_mm256_unpacklo_epi64(low, high), _mm256_unpackhi_epi64(low, high));
+            sums[i] = _mm256_srli_epi16(_mm256_add_epi16(sum, two), 2);
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x), _mm256_permute4x64_epi64(_mm256_packus_epi16(sums[0], sums[1]), 0xD8));
+    }
+    halveRowScalar(top + 2 * x, bottom + 2 * x, dst + x, count - x);
+}
+
+static KernelTable makeKernels() {
+    KernelTable table{};
+    fillFormatKernels<ModelKernels>(table, std::make_index_sequence<formatCount>());
+    table.readtxt = parseText;
+    table.validatetxt = validateText;
+    table.writetxt = writeText;
+    table.resampleRow = resampleRow;
+    table.resampleColumns = resampleColumns;
+    table.halveRow = halveRow;
+    return table;
+}
+const KernelTable* get_avx2Kernels() {
+    static const KernelTable table = makeKernels();
+    return &table;
+}
+#else
+const KernelTable* get_avx2Kernels() {
+    return NULL;
+}
+#endif
@@ -0,0 +1,513 @@
+#include "Kernels.h"
+
+// MSVC has no switch for SSSE3 and allows its intrinsics anywhere on x86.
+#if defined(__SSSE3__) || (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86)))
+#include <cstring>
+#include <tmmintrin.h>
+
+// The byte formats of the RGB models are pure byte permutations, pshufb converts 4 pixels per instruction.
+// CMY additionally inverts the channels and CMYK subtracts black, shuffled into all three of them by a second mask.
+template <ColorFormat cf>
+static inline __m128i decodeBytes(__m128i x, __m128i shuffle, __m128i black) {
+    __m128i pixels = _mm_shuffle_epi8(x, shuffle);
+    if (get_formatLayout(cf).model != ColorModel::RGB) pixels = _mm_xor_si128(pixels, _mm_set1_epi32(0x00FFFFFF));
+    if (get_formatLayout(cf).model == ColorModel::CMYK) pixels = _mm_sub_epi8(pixels, _mm_shuffle_epi8(x, black));
+    return pixels;
+}
+template <ColorFormat cf>
+static void decodeShuffle(const uint8_t* src, Pixel* dst, size_t n) {
+    static constexpr int size = get_formatSize(cf);
+    static constexpr ShuffleMask mask = decodeShuffleMask(size, channelOffset(cf, 0), channelOffset(cf, 1), channelOffset(cf, 2));
+    static constexpr ShuffleMask blackMask = decodeShuffleMask(size, channelOffset(cf, 3), channelOffset(cf, 3), channelOffset(cf, 3));
+    const __m128i shuffle = _mm_load_si128(reinterpret_cast<const __m128i*>(mask.bytes));
+    const __m128i black = _mm_load_si128(reinterpret_cast<const __m128i*>(blackMask.bytes));
+    __m128i* out = reinterpret_cast<__m128i*>(dst);
+    size_t i = 0;
+    if (size == 4) {
+        for (; i + 16 <= n; i += 16, src += 64, out += 4) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16));
+            __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 32));
+            __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 48));
+            _mm_storeu_si128(out, decodeBytes<cf>(a, shuffle, black));
+            _mm_storeu_si128(out + 1, decodeBytes<cf>(b, shuffle, black));
+            _mm_storeu_si128(out + 2, decodeBytes<cf>(c, shuffle, black));
+            _mm_storeu_si128(out + 3, decodeBytes<cf>(d, shuffle, black));
+        }
+    }
+    else {
+        // Every load covers 4 pixels and 4 bytes of the next one, the last load needs 2 pixels of headroom.
+        for (; i + 18 <= n; i += 16, src += 48, out += 4) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 12));
+            __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 24));
+            __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 36));
+            _mm_storeu_si128(out, decodeBytes<cf>(a, shuffle, black));
+            _mm_storeu_si128(out + 1, decodeBytes<cf>(b, shuffle, black));
+            _mm_storeu_si128(out + 2, decodeBytes<cf>(c, shuffle, black));
+            _mm_storeu_si128(out + 3, decodeBytes<cf>(d, shuffle, black));
+        }
+    }
+    get_scalarDecoder(cf)(src, dst + i, n - i);
+}
+// Packs 16 pixels worth of 32 bit words with shuffle and stores them as size bytes each.
+template <int size>
+static inline void storeShuffled(uint8_t* dst, __m128i a, __m128i b, __m128i c, __m128i d, __m128i shuffle) {
+    a = _mm_shuffle_epi8(a, shuffle);
+    b = _mm_shuffle_epi8(b, shuffle);
+    c = _mm_shuffle_epi8(c, shuffle);
+    d = _mm_shuffle_epi8(d, shuffle);
+    if (size == 3) {
+        // 12 bytes per register, stitched into 3 full registers
+        a = _mm_or_si128(a, _mm_slli_si128(b, 12));
+        b = _mm_or_si128(_mm_srli_si128(b, 4), _mm_slli_si128(c, 8));
+        c = _mm_or_si128(_mm_srli_si128(c, 8), _mm_slli_si128(d, 4));
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), a);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16), b);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 32), c);
+    if (size == 4) _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 48), d);
+}
+// HSL and HSV repeat the scalar integer math in 16 bit lanes, 8 pixels per register. Every product fits 16 bits and the
+// divisions are exact reciprocal multiplies for the ranges they see: x / 255 for any x, x / 42 for x up to 42 * 255.
+static inline __m128i divide255(__m128i x) {
+    return _mm_srli_epi16(_mm_mulhi_epu16(x, _mm_set1_epi16(static_cast<short>(0x8081))), 7);
+}
+static inline __m128i divide42(__m128i x) {
+    return _mm_srli_epi16(_mm_mulhi_epu16(x, _mm_set1_epi16(3121)), 1);
+}
+static inline __m128i select(__m128i mask, __m128i a, __m128i b) {
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+// Every channel of 8 pixels, the first 4 from low and the other 4 from high.
+template <ColorFormat cf>
+static inline void loadChannels(const uint8_t* src, __m128i& c0, __m128i& c1, __m128i& c2) {
+    static constexpr int size = get_formatSize(cf);
+    static constexpr ShuffleMask masks[6] = { channelShuffleMask(size, channelOffset(cf, 0), 0), channelShuffleMask(size, channelOffset(cf, 1), 0),
+        channelShuffleMask(size, channelOffset(cf, 2), 0), channelShuffleMask(size, channelOffset(cf, 0), 1), channelShuffleMask(size, channelOffset(cf, 1), 1),
+        channelShuffleMask(size, channelOffset(cf, 2), 1) };
+    __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src)), high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 4 * size));
+    c0 = _mm_or_si128(_mm_shuffle_epi8(low, _mm_load_si128(reinterpret_cast<const __m128i*>(masks[0].bytes))), _mm_shuffle_epi8(high, _mm_load_si128(reinterpret_cast<const __m128i*>(masks[3].bytes))));
+    c1 = _mm_or_si128(_mm_shuffle_epi8(low, _mm_load_si128(reinterpret_cast<const __m128i*>(masks[1].bytes))), _mm_shuffle_epi8(high, _mm_load_si128(reinterpret_cast<const __m128i*>(masks[4].bytes))));
+    c2 = _mm_or_si128(_mm_shuffle_epi8(low, _mm_load_si128(reinterpret_cast<const __m128i*>(masks[2].bytes))), _mm_shuffle_epi8(high, _mm_load_si128(reinterpret_cast<const __m128i*>(masks[5].bytes))));
+}
+static inline void storePixels(Pixel* dst, __m128i red, __m128i green, __m128i blue) {
+    __m128i blueGreen = _mm_or_si128(blue, _mm_slli_epi16(green, 8));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_unpacklo_epi16(blueGreen, red));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 4), _mm_unpackhi_epi16(blueGreen, red));
+}
+static inline __m128i hueToRgb(__m128i p, __m128i q, __m128i t) {
+    const __m128i d = _mm_sub_epi16(q, p);
+    __m128i rising = _mm_add_epi16(p, divide42(_mm_mullo_epi16(t, d)));
+    __m128i falling = _mm_add_epi16(p, divide42(_mm_mullo_epi16(_mm_sub_epi16(_mm_set1_epi16(170), t), d)));
+    __m128i out = select(_mm_cmplt_epi16(t, _mm_set1_epi16(170)), falling, p);
+    out = select(_mm_cmplt_epi16(t, _mm_set1_epi16(128)), q, out);
+    return select(_mm_cmplt_epi16(t, _mm_set1_epi16(42)), rising, out);
+}
+// floor(v * w / (255 * 255)) for w up to 255 * 255, split as w = 255 * w1 + w0 to stay within 16 bits.
+static inline __m128i scale65025(__m128i v, __m128i w) {
+    __m128i w1 = divide255(w), w0 = _mm_sub_epi16(w, _mm_mullo_epi16(w1, _mm_set1_epi16(255)));
+    return divide255(_mm_add_epi16(_mm_mullo_epi16(v, w1), divide255(_mm_mullo_epi16(v, w0))));
+}
+// 3 byte pixels need 2 pixels of headroom for the 16 byte loads.
+template <ColorFormat cf>
+static void decodeHSL(const uint8_t* src, Pixel* dst, size_t n) {
+    const __m128i byte = _mm_set1_epi16(0xFF), zero = _mm_setzero_si128();
+    static constexpr int size = get_formatSize(cf);
+    size_t i = 0;
+    for (; i + (size == 3 ? 10 : 8) <= n; i += 8, src += 8 * size) {
+        __m128i h, s, l;
+        loadChannels<cf>(src, h, s, l);
+        __m128i ls = divide255(_mm_mullo_epi16(l, s));
+        __m128i q = select(_mm_cmplt_epi16(l, _mm_set1_epi16(128)), _mm_add_epi16(l, ls), _mm_sub_epi16(_mm_add_epi16(l, s), ls));
+        __m128i p = _mm_sub_epi16(_mm_add_epi16(l, l), q);
+        // The hue wraps around like the uint8_t it is in the scalar code
+        __m128i tRed = _mm_and_si128(_mm_add_epi16(h, _mm_set1_epi16(87)), byte), tBlue = _mm_and_si128(_mm_sub_epi16(h, _mm_set1_epi16(87)), byte);
+        __m128i gray = _mm_cmpeq_epi16(s, zero);
+        storePixels(dst + i, select(gray, l, hueToRgb(p, q, tRed)), select(gray, l, hueToRgb(p, q, h)), select(gray, l, hueToRgb(p, q, tBlue)));
+    }
+    get_scalarDecoder(cf)(src, dst + i, n - i);
+}
+template <ColorFormat cf>
+static void decodeHSV(const uint8_t* src, Pixel* dst, size_t n) {
+    const __m128i c255 = _mm_set1_epi16(255), c65025 = _mm_set1_epi16(static_cast<short>(65025));
+    static constexpr int size = get_formatSize(cf);
+    size_t i = 0;
+    for (; i + (size == 3 ? 10 : 8) <= n; i += 8, src += 8 * size) {
+        __m128i h, s, v;
+        loadChannels<cf>(src, h, s, v);
+        __m128i sector = divide42(h);
+        __m128i ff = _mm_mullo_epi16(_mm_sub_epi16(h, _mm_mullo_epi16(sector, _mm_set1_epi16(42))), _mm_set1_epi16(6));
+        __m128i p = divide255(_mm_mullo_epi16(v, _mm_sub_epi16(c255, s)));
+        __m128i q = scale65025(v, _mm_sub_epi16(c65025, _mm_mullo_epi16(s, ff)));
+        __m128i t = scale65025(v, _mm_sub_epi16(c65025, _mm_mullo_epi16(s, _mm_sub_epi16(c255, ff))));
+        // Sector 6 only holds hues 252 to 255 and shares the scalar default case with sector 5
+        __m128i s0 = _mm_cmpeq_epi16(sector, _mm_setzero_si128()), s1 = _mm_cmpeq_epi16(sector, _mm_set1_epi16(1)), s2 = _mm_cmpeq_epi16(sector, _mm_set1_epi16(2));
+        __m128i s3 = _mm_cmpeq_epi16(sector, _mm_set1_epi16(3)), s4 = _mm_cmpeq_epi16(sector, _mm_set1_epi16(4));
+        __m128i red = select(s1, q, select(_mm_or_si128(s2, s3), p, select(s4, t, v)));
+        __m128i green = select(s0, t, select(_mm_or_si128(s1, s2), v, select(s3, q, p)));
+        __m128i blue = select(_mm_or_si128(s0, s1), p, select(s2, t, select(_mm_or_si128(s3, s4), v, q)));
+        __m128i gray = _mm_cmpeq_epi16(s, _mm_setzero_si128());
+        storePixels(dst + i, select(gray, v, red), select(gray, v, green), select(gray, v, blue));
+    }
+    get_scalarDecoder(cf)(src, dst + i, n - i);
+}
+// The HSL and HSV encoders divide by values that depend on the pixel. Every numerator is an integer below 2^24 and the
+// quotients stay below 256, so a correctly rounded float division truncates to the same integer as the scalar code.
+static inline __m128i truncateDivide(__m128 x, __m128 y) {
+    return _mm_cvttps_epi32(_mm_div_ps(x, y));
+}
+static inline __m128 selectFloat(__m128 mask, __m128 a, __m128 b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+// Splits 4 pixels into one float per channel.
+static inline void unpackPixels(__m128i pixels, __m128& red, __m128& green, __m128& blue) {
+    const __m128i byte = _mm_set1_epi32(0xFF);
+    blue = _mm_cvtepi32_ps(_mm_and_si128(pixels, byte));
+    green = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(pixels, 8), byte));
+    red = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(pixels, 16), byte));
+}
+// Hue shared by HSL and HSV, truncated towards zero and wrapped into a byte like the scalar code.
+static inline __m128i encodeHue(__m128 red, __m128 green, __m128 blue, __m128 max, __m128 d) {
+    __m128 isRed = _mm_cmpeq_ps(max, red), isGreen = _mm_andnot_ps(isRed, _mm_cmpeq_ps(max, green));
+    __m128 difference = selectFloat(isRed, _mm_sub_ps(green, blue), selectFloat(isGreen, _mm_sub_ps(blue, red), _mm_sub_ps(red, green)));
+    __m128i offset = _mm_castps_si128(selectFloat(isRed, _mm_setzero_ps(), selectFloat(isGreen, _mm_castsi128_ps(_mm_set1_epi32(84)), _mm_castsi128_ps(_mm_set1_epi32(168)))));
+    __m128i h = _mm_add_epi32(truncateDivide(_mm_mul_ps(difference, _mm_set1_ps(42.0f)), d), offset);
+    return _mm_and_si128(h, _mm_set1_epi32(0xFF));
+}
+// Channel bytes h, s and l/v in the places of red, green and blue, so they pack like the RGB formats.
+static inline __m128i hslWords(__m128i pixels) {
+    __m128 red, green, blue;
+    unpackPixels(pixels, red, green, blue);
+    __m128 max = _mm_max_ps(_mm_max_ps(red, green), blue), min = _mm_min_ps(_mm_min_ps(red, green), blue);
+    __m128 d = _mm_sub_ps(max, min), sum = _mm_add_ps(max, min);
+    __m128i l = _mm_cvttps_epi32(_mm_mul_ps(sum, _mm_set1_ps(0.5f)));
+    // l > 127 exactly when max + min > 255
+    __m128 denominator = selectFloat(_mm_cmpgt_ps(sum, _mm_set1_ps(255.0f)), _mm_sub_ps(_mm_set1_ps(510.0f), sum), sum);
+    __m128i s = truncateDivide(_mm_mul_ps(d, _mm_set1_ps(255.0f)), denominator);
+    __m128i h = encodeHue(red, green, blue, max, d);
+    // Gray pixels divide by zero, their hue and saturation are replaced by 0
+    __m128i gray = _mm_castps_si128(_mm_cmpeq_ps(d, _mm_setzero_ps()));
+    return _mm_or_si128(_mm_andnot_si128(gray, _mm_or_si128(_mm_slli_epi32(h, 16), _mm_slli_epi32(s, 8))), l);
+}
+static inline __m128i hsvWords(__m128i pixels) {
+    __m128 red, green, blue;
+    unpackPixels(pixels, red, green, blue);
+    __m128 max = _mm_max_ps(_mm_max_ps(red, green), blue), min = _mm_min_ps(_mm_min_ps(red, green), blue);
+    __m128 d = _mm_sub_ps(max, min);
+    __m128i s = truncateDivide(_mm_mul_ps(d, _mm_set1_ps(255.0f)), max);
+    __m128i h = encodeHue(red, green, blue, max, d);
+    __m128i gray = _mm_castps_si128(_mm_cmpeq_ps(d, _mm_setzero_ps()));
+    return _mm_or_si128(_mm_andnot_si128(gray, _mm_or_si128(_mm_slli_epi32(h, 16), _mm_slli_epi32(s, 8))), _mm_cvttps_epi32(max));
+}
+// The other byte models are converted into the same words in place, CMYK stays in bytes: invert red, green and blue,
+// take k as their minimum, subtract it and put k in the reserved byte.
+static inline __m128i rgbWords(__m128i pixels) {
+    return pixels;
+}
+static inline __m128i cmyWords(__m128i pixels) {
+    return _mm_xor_si128(pixels, _mm_set1_epi32(0x00FFFFFF));
+}
+static inline __m128i cmykWords(__m128i pixels) {
+    const __m128i broadcast = _mm_setr_epi8(0, 0, 0, 0, 4, 4, 4, 4, 8, 8, 8, 8, 12, 12, 12, 12);
+    const __m128i invert = _mm_set1_epi32(0x00FFFFFF), black = _mm_set1_epi32(static_cast<int>(0xFF000000));
+    __m128i cmy = _mm_xor_si128(pixels, invert);
+    __m128i k = _mm_min_epu8(_mm_min_epu8(cmy, _mm_srli_epi32(cmy, 8)), _mm_srli_epi32(cmy, 16));
+    k = _mm_shuffle_epi8(k, broadcast);
+    return _mm_or_si128(_mm_and_si128(_mm_sub_epi8(cmy, k), invert), _mm_and_si128(k, black));
+}
+// Channels 0, 1 and 2 of the model are in the places of red, green and blue of the words, channel 3 in the reserved byte.
+template <ColorFormat cf, __m128i(*words)(__m128i)>
+static void encodeWords(const Pixel* src, uint8_t* dst, size_t n) {
+    static constexpr int size = get_formatSize(cf);
+    static constexpr ShuffleMask mask = encodeShuffleMask(size, channelOffset(cf, 0), channelOffset(cf, 1), channelOffset(cf, 2), channelOffset(cf, 3));
+    const __m128i shuffle = _mm_load_si128(reinterpret_cast<const __m128i*>(mask.bytes));
+    const __m128i* in = reinterpret_cast<const __m128i*>(src);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16, in += 4, dst += 16 * size)
+        storeShuffled<size>(dst, words(_mm_loadu_si128(in)), words(_mm_loadu_si128(in + 1)), words(_mm_loadu_si128(in + 2)), words(_mm_loadu_si128(in + 3)), shuffle);
+    get_scalarEncoder(cf)(src + i, dst, n - i);
+}
+// FloatHSL layouts of 4 float64 slots, 2 pixels per iteration. The math repeats the scalar code operation for operation
+// with the branches turned into masks, so the bytes match exactly.
+static inline __m128d selectDouble(__m128d mask, __m128d a, __m128d b) {
+    return _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b));
+}
+static inline __m128d pythonHueToRgb(__m128d p, __m128d q, __m128d t) {
+    const __m128d circle = _mm_set1_pd(360.0), sixty = _mm_set1_pd(60.0), scale = _mm_set1_pd(255.0);
+    t = _mm_add_pd(t, _mm_and_pd(_mm_cmplt_pd(t, _mm_setzero_pd()), circle));
+    t = _mm_sub_pd(t, _mm_and_pd(_mm_cmpgt_pd(t, circle), circle));
+    __m128d difference = _mm_sub_pd(q, p);
+    __m128d rising = _mm_mul_pd(_mm_add_pd(p, _mm_div_pd(_mm_mul_pd(difference, t), sixty)), scale);
+    __m128d falling = _mm_mul_pd(_mm_add_pd(p, _mm_div_pd(_mm_mul_pd(difference, _mm_sub_pd(_mm_set1_pd(240.0), t)), sixty)), scale);
+    return selectDouble(_mm_cmplt_pd(t, sixty), rising, selectDouble(_mm_cmplt_pd(t, _mm_set1_pd(180.0)), _mm_mul_pd(q, scale),
+        selectDouble(_mm_cmplt_pd(t, _mm_set1_pd(240.0)), falling, _mm_mul_pd(p, scale))));
+}
+// Clamps like the scalar pythonToByte, minpd returns the second operand for NaN.
+static inline __m128i pythonToBytes(__m128d x) {
+    return _mm_cvttpd_epi32(_mm_max_pd(_mm_min_pd(x, _mm_set1_pd(255.0)), _mm_setzero_pd()));
+}
+template <ColorFormat cf>
+static void decodeFloatHSL(const uint8_t* src, Pixel* dst, size_t n) {
+    const __m128d scale = _mm_set1_pd(255.0), third = _mm_set1_pd(120.0);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2, src += 64) {
+        const double* in = reinterpret_cast<const double*>(src);
+        __m128d a = _mm_loadu_pd(in), b = _mm_loadu_pd(in + 2), c = _mm_loadu_pd(in + 4), d = _mm_loadu_pd(in + 6);
+        // Every slot of both pixels
+        const __m128d slots[4] = { _mm_unpacklo_pd(a, c), _mm_unpackhi_pd(a, c), _mm_unpacklo_pd(b, d), _mm_unpackhi_pd(b, d) };
+        __m128d h = slots[get_formatLayout(cf).slots[0]], s = slots[get_formatLayout(cf).slots[1]], l = slots[get_formatLayout(cf).slots[2]];
+        __m128d q = selectDouble(_mm_cmplt_pd(l, _mm_set1_pd(0.5)), _mm_mul_pd(l, _mm_add_pd(_mm_set1_pd(1.0), s)), _mm_sub_pd(_mm_add_pd(l, s), _mm_mul_pd(l, s)));
+        __m128d p = _mm_sub_pd(_mm_mul_pd(_mm_set1_pd(2.0), l), q);
+        __m128d gray = _mm_cmpeq_pd(s, _mm_setzero_pd()), lightness = _mm_mul_pd(l, scale);
+        __m128i red = pythonToBytes(selectDouble(gray, lightness, pythonHueToRgb(p, q, _mm_add_pd(h, third))));
+        __m128i green = pythonToBytes(selectDouble(gray, lightness, pythonHueToRgb(p, q, h)));
+        __m128i blue = pythonToBytes(selectDouble(gray, lightness, pythonHueToRgb(p, q, _mm_sub_pd(h, third))));
+        __m128i pixels = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(red, 16), _mm_slli_epi32(green, 8)), blue);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i), pixels);
+    }
+    get_scalarDecoder(cf)(src, dst + i, n - i);
+}
+template <ColorFormat cf>
+static void encodeFloatHSL(const Pixel* src, uint8_t* dst, size_t n) {
+    const __m128i byte = _mm_set1_epi32(0xFF);
+    const __m128d zero = _mm_setzero_pd(), sixty = _mm_set1_pd(60.0);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2, dst += 64) {
+        __m128i pixels = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i));
+        __m128d blue = _mm_cvtepi32_pd(_mm_and_si128(pixels, byte));
+        __m128d green = _mm_cvtepi32_pd(_mm_and_si128(_mm_srli_epi32(pixels, 8), byte));
+        __m128d red = _mm_cvtepi32_pd(_mm_and_si128(_mm_srli_epi32(pixels, 16), byte));
+        __m128d max = _mm_max_pd(_mm_max_pd(red, green), blue), min = _mm_min_pd(_mm_min_pd(red, green), blue);
+        __m128d l = _mm_add_pd(max, min), d = _mm_sub_pd(max, min);
+        __m128d s = selectDouble(_mm_cmpgt_pd(l, _mm_set1_pd(255.0)), _mm_div_pd(d, _mm_sub_pd(_mm_set1_pd(510.0), l)), _mm_div_pd(d, l));
+        __m128d hr = _mm_add_pd(_mm_div_pd(_mm_mul_pd(_mm_sub_pd(green, blue), sixty), d), _mm_and_pd(_mm_cmplt_pd(green, blue), _mm_set1_pd(360.0)));
+        __m128d hg = _mm_add_pd(_mm_div_pd(_mm_mul_pd(_mm_sub_pd(blue, red), sixty), d), _mm_set1_pd(120.0));
+        __m128d hb = _mm_add_pd(_mm_div_pd(_mm_mul_pd(_mm_sub_pd(red, green), sixty), d), _mm_set1_pd(240.0));
+        __m128d h = selectDouble(_mm_cmpeq_pd(max, red), hr, selectDouble(_mm_cmpeq_pd(max, green), hg, hb));
+        __m128d gray = _mm_cmpeq_pd(max, min);
+        h = _mm_andnot_pd(gray, h);
+        s = _mm_andnot_pd(gray, s);
+        l = _mm_div_pd(l, _mm_set1_pd(512.0));
+        const __m128d channels[4] = { h, s, l, zero };
+        __m128d slots[4];
+        for (int slot = 0; slot < 4; slot++)
+            slots[slot] = channels[slotChannel(cf, slot) < 0 ? 3 : slotChannel(cf, slot)];
+        double* out = reinterpret_cast<double*>(dst);
+        _mm_storeu_pd(out, _mm_unpacklo_pd(slots[0], slots[1]));
+        _mm_storeu_pd(out + 2, _mm_unpacklo_pd(slots[2], slots[3]));
+        _mm_storeu_pd(out + 4, _mm_unpackhi_pd(slots[0], slots[1]));
+        _mm_storeu_pd(out + 6, _mm_unpackhi_pd(slots[2], slots[3]));
+    }
+    get_scalarEncoder(cf)(src + i, dst, n - i);
+}
+// Checks and packs 64 characters per iteration: every character must be '0' + 0 or '0' + 1,
+// reversing each group of 8 lets movemask put the first character into the top bit of its byte.
+static size_t parseText(const char* text, uint8_t* data, size_t count) {
+    const __m128i zero = _mm_set1_epi8('0'), invalid = _mm_set1_epi8(static_cast<char>(0xFE));
+    const __m128i reverse = _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8, text += 64) {
+        __m128i a = _mm_sub_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(text)), zero);
+        __m128i b = _mm_sub_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(text + 16)), zero);
+        __m128i c = _mm_sub_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(text + 32)), zero);
+        __m128i d = _mm_sub_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(text + 48)), zero);
+        __m128i bad = _mm_and_si128(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d)), invalid);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(bad, _mm_setzero_si128())) != 0xFFFF) break;
+        uint64_t bits = static_cast<uint64_t>(_mm_movemask_epi8(_mm_slli_epi16(_mm_shuffle_epi8(a, reverse), 7)))
+            | static_cast<uint64_t>(_mm_movemask_epi8(_mm_slli_epi16(_mm_shuffle_epi8(b, reverse), 7))) << 16
+            | static_cast<uint64_t>(_mm_movemask_epi8(_mm_slli_epi16(_mm_shuffle_epi8(c, reverse), 7))) << 32
+            | static_cast<uint64_t>(_mm_movemask_epi8(_mm_slli_epi16(_mm_shuffle_epi8(d, reverse), 7))) << 48;
+        memcpy(data + i, &bits, 8);
+    }
+    // The scalar parser also finds the exact byte a bad block stopped at
+    return i + readtxtScalar(text, data + i, count - i);
+}
+// Counts the characters that aren't '0' or '1', 64 per iteration.
+static size_t validateText(const char* text, size_t length, size_t* first) {
+    const __m128i zero = _mm_set1_epi8('0'), invalid = _mm_set1_epi8(static_cast<char>(0xFE));
+    size_t count = 0, i = 0;
+    for (; i + 64 <= length; i += 64) {
+        __m128i a = _mm_and_si128(_mm_sub_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i)), zero), invalid);
+        __m128i b = _mm_and_si128(_mm_sub_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i + 16)), zero), invalid);
+        __m128i c = _mm_and_si128(_mm_sub_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i + 32)), zero), invalid);
+        __m128i d = _mm_and_si128(_mm_sub_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i + 48)), zero), invalid);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d)), _mm_setzero_si128())) == 0xFFFF) continue;
+        const __m128i parts[4] = { a, b, c, d };
+        for (int k = 0; k < 4; k++) {
+            uint32_t bad = ~static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(parts[k], _mm_setzero_si128()))) & 0xFFFFu;
+            if (bad == 0) continue;
+            if (count == 0) *first = i + 16 * k + countTrailingZeros(bad);
+            count += popcount32(bad);
+        }
+    }
+    size_t tailFirst = 0;
+    size_t tailCount = validatetxtScalar(text + i, length - i, &tailFirst);
+    if (tailCount != 0 && count == 0) *first = i + tailFirst;
+    return count + tailCount;
+}
+// Broadcasts every byte to 8 lanes, tests one bit per lane and turns the result into '0' or '1', 2 bytes per register.
+static void writeText(const uint8_t* data, char* text, size_t count) {
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i spread = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1);
+    const __m128i bits = _mm_setr_epi8(-128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16, 8, 4, 2, 1);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8, text += 64) {
+        __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(data + i));
+        for (int k = 0; k < 4; k++) {
+            __m128i pair = _mm_shuffle_epi8(bytes, _mm_add_epi8(spread, _mm_set1_epi8(static_cast<char>(2 * k))));
+            __m128i set = _mm_cmpeq_epi8(_mm_and_si128(pair, bits), bits);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(text + 16 * k), _mm_sub_epi8(zero, set));
+        }
+    }
+    writetxtScalar(data + i, text, count - i);
+}
+
+// The kernels above for every layout they handle, Gray has none. Kept out of the global namespace like everything
+// else here, the other kernel files define their own.
+namespace {
+template <ColorModel model>
+struct ModelKernels {
+    template <ColorFormat cf>
+    static ColorFormatDecoder decoder() { return NULL; }
+    template <ColorFormat cf>
+    static ColorFormatEncoder encoder() { return NULL; }
+};
+template <>
+struct ModelKernels<ColorModel::RGB> {
+    template <ColorFormat cf>
+    static ColorFormatDecoder decoder() { return isBytePixel(cf) ? decodeShuffle<cf> : NULL; }
+    template <ColorFormat cf>
+    static ColorFormatEncoder encoder() { return isBytePixel(cf) ? encodeWords<cf, rgbWords> : NULL; }
+};
+template <>
+struct ModelKernels<ColorModel::CMY> {
+    template <ColorFormat cf>
+    static ColorFormatDecoder decoder() { return isBytePixel(cf) ? decodeShuffle<cf> : NULL; }
+    template <ColorFormat cf>
+    static ColorFormatEncoder encoder() { return isBytePixel(cf) ? encodeWords<cf, cmyWords> : NULL; }
+};
+template <>
+struct ModelKernels<ColorModel::CMYK> {
+    template <ColorFormat cf>
+    static ColorFormatDecoder decoder() { return isBytePixel(cf) ? decodeShuffle<cf> : NULL; }
+    template <ColorFormat cf>
+    static ColorFormatEncoder encoder() { return isBytePixel(cf) ? encodeWords<cf, cmykWords> : NULL; }
+};
+template <>
+struct ModelKernels<ColorModel::HSL> {
+    template <ColorFormat cf>
+    static ColorFormatDecoder decoder() { return isBytePixel(cf) ? decodeHSL<cf> : NULL; }
+    template <ColorFormat cf>
+    static ColorFormatEncoder encoder() { return isBytePixel(cf) ? encodeWords<cf, hslWords> : NULL; }
+};
+template <>
+struct ModelKernels<ColorModel::HSV> {
+    template <ColorFormat cf>
+    static ColorFormatDecoder decoder() { return isBytePixel(cf) ? decodeHSV<cf> : NULL; }
+    template <ColorFormat cf>
+    static ColorFormatEncoder encoder() { return isBytePixel(cf) ? encodeWords<cf, hsvWords> : NULL; }
+};
+template <>
+struct ModelKernels<ColorModel::FloatHSL> {
+    template <ColorFormat cf>
+    static ColorFormatDecoder decoder() { return isFloatPixel(cf) ? decodeFloatHSL<cf> : NULL; }
+    template <ColorFormat cf>
+    static ColorFormatEncoder encoder() { return isFloatPixel(cf) ? encodeFloatHSL<cf> : NULL; }
+};
+}
+
+// Both resamplers keep 32 bit sums of channel * weight and feed pmaddwd pairs of 16 bit channels, so every
+// instruction applies two taps. The horizontal one interleaves the channels of neighbouring pixels with pshufb.
+static inline __m128i weightPair(int16_t first, int16_t second) {
+    return _mm_set1_epi32(static_cast<int32_t>(static_cast<uint16_t>(first) | static_cast<uint32_t>(static_cast<uint16_t>(second)) << 16));
+}
+static inline __m128i packSums(__m128i low, __m128i high) {
+    return _mm_packs_epi32(_mm_srai_epi32(low, resampleBits), _mm_srai_epi32(high, resampleBits));
+}
+static void resampleRow(const Pixel* src, Pixel* dst, size_t width, const int32_t* starts, const int16_t* weights, size_t taps) {
+    const __m128i pairs = _mm_setr_epi8(0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13, 10, 14, 11, 15);
+    const __m128i zero = _mm_setzero_si128();
+    for (size_t x = 0; x < width; x++, weights += taps) {
+        const Pixel* in = src + starts[x];
+        __m128i sum = _mm_set1_epi32(1 << (resampleBits - 1));
+        size_t k = 0;
+        for (; k + 4 <= taps; k += 4) {
+            __m128i pixels = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + k)), pairs);
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_unpacklo_epi8(pixels, zero), weightPair(weights[k], weights[k + 1])));
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_unpackhi_epi8(pixels, zero), weightPair(weights[k + 2], weights[k + 3])));
+        }
+        for (; k + 2 <= taps; k += 2) {
+            __m128i pixels = _mm_shuffle_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in + k)), pairs);
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_unpacklo_epi8(pixels, zero), weightPair(weights[k], weights[k + 1])));
+        }
+        if (k < taps) {
+            int32_t value;
+            memcpy(&value, in + k, sizeof(value));
+            __m128i pixel = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(value), zero), zero);
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(pixel, weightPair(weights[k], 0)));
+        }
+        __m128i packed = packSums(sum, sum);
+        *reinterpret_cast<int32_t*>(dst + x) = _mm_cvtsi128_si32(_mm_packus_epi16(packed, packed));
+    }
+}
+static void resampleColumns(const Pixel* const* rows, const int16_t* weights, size_t taps, Pixel* dst, size_t begin, size_t end) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t x = begin;
+    for (; x + 4 <= end; x += 4) {
+        __m128i sums[4];
+        for (__m128i& sum : sums) sum = _mm_set1_epi32(1 << (resampleBits - 1));
+        for (size_t k = 0; k < taps; k += 2) {
+            // Odd tap counts pair the last row with zeros
+            __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[k] + x));
+            __m128i second = k + 1 < taps ? _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[k + 1] + x)) : zero;
+            __m128i weight = weightPair(weights[k], k + 1 < taps ? weights[k + 1] : 0);
+            __m128i low = _mm_unpacklo_epi8(first, second), high = _mm_unpackhi_epi8(first, second);
+            sums[0] = _mm_add_epi32(sums[0], _mm_madd_epi16(_mm_unpacklo_epi8(low, zero), weight));
+            sums[1] = _mm_add_epi32(sums[1], _mm_madd_epi16(_mm_unpackhi_epi8(low, zero), weight));
+            sums[2] = _mm_add_epi32(sums[2], _mm_madd_epi16(_mm_unpacklo_epi8(high, zero), weight));
+            sums[3] = _mm_add_epi32(sums[3], _mm_madd_epi16(_mm_unpackhi_epi8(high, zero), weight));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), _mm_packus_epi16(packSums(sums[0], sums[1]), packSums(sums[2], sums[3])));
+    }
+    resampleColumnsScalar(rows, weights, taps, dst, x, end);
+}
+// Sums the rows in 16 bits, then adds the pixel pairs by splitting the registers into their even and odd pixels.
+static void halveRow(const Pixel* top, const Pixel* bottom, Pixel* dst, size_t count) {
+    const __m128i zero = _mm_setzero_si128(), two = _mm_set1_epi16(2);
+    size_t x = 0;
+    for (; x + 4 <= count; x += 4) {
+        __m128i sums[2];
+        for (int i = 0; i < 2; i++) {
+            __m128i upper = _mm_loadu_si128(reinterpret_cast<const __m128i*>(top + 2 * x + 4 * i));
+            __m128i lower = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bottom + 2 * x + 4 * i));
+            __m128i low = _mm_add_epi16(_mm_unpacklo_epi8(upper, zero), _mm_unpacklo_epi8(lower, zero));
+            __m128i high = _mm_add_epi16(_mm_unpackhi_epi8(upper, zero), _mm_unpackhi_epi8(lower, zero));
+            __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(low, high), _mm_unpackhi_epi64(low, high));
+            sums[i] = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), _mm_packus_epi16(sums[0], sums[1]));
+    }
+    halveRowScalar(top + 2 * x, bottom + 2 * x, dst + x, count - x);
+}
+
+static KernelTable makeKernels() {
+    KernelTable table{};
+    fillFormatKernels<ModelKernels>(table, std::make_index_sequence<formatCount>());
+    table.readtxt = parseText;
+    table.validatetxt = validateText;
+    table.writetxt = writeText;
+    table.resampleRow = resampleRow;
+    table.resampleColumns = resampleColumns;
+    table.halveRow = halveRow;
+    return table;
+}
+const KernelTable* get_ssse3Kernels() {
+    static const KernelTable table = makeKernels();
+    return &table;
+}
+#else
+const KernelTable* get_ssse3Kernels() {
+    return NULL;
+}
+#endif
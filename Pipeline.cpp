@@ -0,0 +1,286 @@
+#include "Pipeline.h"
+#include "Qoi.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Chunks are a multiple of 8 so .txt files split on byte boundaries.
+static constexpr size_t chunkSize = 1 << 20;
+static constexpr size_t chunkCount = 3;
+static constexpr size_t readFailed = SIZE_MAX;
+// Bytes per piece of work when converting .txt chunks on the thread pool
+static constexpr size_t textGrain = 1 << 13;
+
+namespace {
+// Chunks go round a ring, the reader thread fills them in order and the decoder takes them in the same order.
+// Every chunk but the last one is full.
+class ChunkReader {
+public:
+    explicit ChunkReader(InputFile& file) : file(file), buffers(new char[chunkSize * chunkCount]), thread(&ChunkReader::run, this) {}
+    ~ChunkReader() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        changed.notify_all();
+        thread.join();
+    }
+    // Waits for the next chunk, returns false if it couldn't be read.
+    bool next(char*& data, size_t& size) {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this] { return filled > consumed; });
+        size_t index = consumed % chunkCount;
+        data = buffers.get() + index * chunkSize;
+        size = sizes[index];
+        return size != readFailed;
+    }
+    // Hands the chunk from next back to the reader.
+    void release() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            consumed++;
+        }
+        changed.notify_all();
+    }
+
+private:
+    void run() {
+        for (;;) {
+            size_t index;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [this] { return stopping || filled - consumed < chunkCount; });
+                if (stopping) return;
+                index = filled % chunkCount;
+            }
+            size_t count;
+            bool ok = file.read(buffers.get() + index * chunkSize, chunkSize, count);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                sizes[index] = ok ? count : readFailed;
+                filled++;
+            }
+            changed.notify_all();
+            if (!ok || count < chunkSize) return;
+        }
+    }
+
+    InputFile& file;
+    std::unique_ptr<char[]> buffers;
+    size_t sizes[chunkCount] = {};
+    size_t filled = 0, consumed = 0;
+    bool stopping = false;
+    std::mutex mutex;
+    std::condition_variable changed;
+    // Started last, once everything it uses exists
+    std::thread thread;
+};
+// The other way round, the encoder fills the chunks and the writer thread writes them in order.
+class ChunkWriter {
+public:
+    explicit ChunkWriter(OutputFile& file) : file(file), buffers(new char[chunkSize * chunkCount]), thread(&ChunkWriter::run, this) {}
+    ~ChunkWriter() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        changed.notify_all();
+        thread.join();
+    }
+    // Waits for a chunk that has been written and can be filled again, NULL once a write failed.
+    char* next() {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this] { return filled - written < chunkCount; });
+        if (failed) return nullptr;
+        return buffers.get() + filled % chunkCount * chunkSize;
+    }
+    // Queues the chunk from next with size bytes in it.
+    void submit(size_t size) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            sizes[filled % chunkCount] = size;
+            filled++;
+        }
+        changed.notify_all();
+    }
+    // Waits until everything queued is written, returns false if anything failed.
+    bool finish() {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this] { return written == filled; });
+        return !failed;
+    }
+
+private:
+    void run() {
+        for (;;) {
+            size_t index, size;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [this] { return stopping || filled > written; });
+                if (filled == written) return;
+                index = written % chunkCount;
+                size = sizes[index];
+            }
+            bool ok = !failed && file.write(buffers.get() + index * chunkSize, size);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                failed = !ok;
+                written++;
+            }
+            changed.notify_all();
+        }
+    }
+
+    OutputFile& file;
+    std::unique_ptr<char[]> buffers;
+    size_t sizes[chunkCount] = {};
+    size_t filled = 0, written = 0;
+    bool stopping = false, failed = false;
+    std::mutex mutex;
+    std::condition_variable changed;
+    // Started last, once everything it uses exists
+    std::thread thread;
+};
+// Decodes raw bytes arriving in pieces of any size, a pixel split between two pieces is carried over.
+class ChunkDecoder {
+public:
+    ChunkDecoder(ColorFormat cf, Pixel* image, size_t imageSize) : cf(cf), decoder(get_decoder(cf)), pixelSize(get_pixelSize(cf)), image(image), imageSize(imageSize) {}
+    void push(const uint8_t* data, size_t size) {
+        if (carryCount != 0 && !full()) {
+            size_t count = std::min(pixelSize - carryCount, size);
+            memcpy(carry + carryCount, data, count);
+            carryCount += count;
+            data += count;
+            size -= count;
+            if (carryCount < pixelSize) return;
+            decoder(carry, image + decoded++, 1);
+            carryCount = 0;
+        }
+        size_t count = std::min(size / pixelSize, imageSize - decoded);
+        decodePixels(reinterpret_cast<const char*>(data), cf, image + decoded, count);
+        decoded += count;
+        if (full()) return;
+        carryCount = size - count * pixelSize;
+        memcpy(carry, data + count * pixelSize, carryCount);
+    }
+    bool full() const { return decoded == imageSize; }
+    size_t count() const { return decoded; }
+
+private:
+    ColorFormat cf;
+    ColorFormatDecoder decoder;
+    size_t pixelSize;
+    Pixel* image;
+    size_t imageSize;
+    size_t decoded = 0;
+    // Large enough for the biggest pixel, Python's 4 doubles
+    uint8_t carry[4 * sizeof(double)];
+    size_t carryCount = 0;
+};
+}
+
+// Checks and converts a .txt chunk on the thread pool, pieces stay a multiple of 8 characters.
+static void parseChunk(const char* text, size_t size, size_t offset, uint8_t* data, TextError& error) {
+    std::mutex merging;
+    parallelFor(size / 8, textGrain, [&](size_t begin, size_t end) {
+        TextError piece;
+        validatetxt(text + begin * 8, (end - begin) * 8, offset + begin * 8, piece);
+        if (piece.count == 0) {
+            readtxt(text + begin * 8, data + begin, end - begin);
+            return;
+        }
+        std::lock_guard<std::mutex> lock(merging);
+        if (error.count == 0 || piece.firstOffset < error.firstOffset) error.firstOffset = piece.firstOffset;
+        error.count += piece.count;
+    });
+}
+StreamStatus decodeFile(InputFile& file, ImageFormat type, ColorFormat cf, Pixel* image, size_t imageSize, TextError& error) {
+    return decodeFile(file, type, cf, image, imageSize, error, [](uint64_t) { return true; });
+}
+StreamStatus decodeFile(InputFile& file, ImageFormat type, ColorFormat cf, Pixel* image, size_t imageSize, TextError& error,
+    const DecodeProgress& progress) {
+    ChunkDecoder decoder(cf, image, imageSize);
+    QoiDecoder qoi(image, imageSize);
+    std::unique_ptr<uint8_t[]> bytes(type == ImageFormat::txt ? new uint8_t[chunkSize / 8] : nullptr);
+    ChunkReader reader(file);
+    for (size_t offset = 0;; ) {
+        char* chunk;
+        size_t size;
+        if (!reader.next(chunk, size)) return StreamStatus::readError;
+        if (type == ImageFormat::txt) {
+            // Nothing is decoded past the first invalid character
+            parseChunk(chunk, size, offset, bytes.get(), error);
+            if (error.count == 0) decoder.push(bytes.get(), size / 8);
+        }
+        else if (type == ImageFormat::qoi) qoi.push(reinterpret_cast<const uint8_t*>(chunk), size);
+        else decoder.push(reinterpret_cast<const uint8_t*>(chunk), size);
+        offset += size;
+        reader.release();
+        if (!progress(type == ImageFormat::qoi ? qoi.count() : decoder.count())) return StreamStatus::cancelled;
+        if (size < chunkSize) break;
+        // The rest of a .bin or .qoi file isn't needed once the image is full
+        if ((type == ImageFormat::bin && decoder.full()) || (type == ImageFormat::qoi && qoi.full())) break;
+    }
+    if (error.count != 0) return StreamStatus::invalidText;
+    if (type == ImageFormat::qoi) return qoi.full() ? StreamStatus::ok : StreamStatus::truncated;
+    repeatImage(image, decoder.count(), imageSize);
+    return decoder.count() == imageSize || progress(imageSize) ? StreamStatus::ok : StreamStatus::cancelled;
+}
+// QOI only encodes one pixel after the other, so this thread encodes while the writer thread writes.
+static bool encodeQoi(OutputFile& file, const PixelSource& source, uint64_t imageSize) {
+    QoiEncoder encoder;
+    size_t pixelsPerChunk = (chunkSize - 1 - qoiEndSize) / 4;
+    static_assert(QoiEncoder::maxSize((chunkSize - 1 - qoiEndSize) / 4) + 1 + qoiEndSize <= chunkSize, "a chunk holds the end marker too");
+    std::unique_ptr<Pixel[]> scratch(new Pixel[pixelsPerChunk]);
+    ChunkWriter writer(file);
+    for (uint64_t i = 0; ; i += pixelsPerChunk) {
+        size_t count = static_cast<size_t>(std::min<uint64_t>(pixelsPerChunk, imageSize - i));
+        uint8_t* chunk = reinterpret_cast<uint8_t*>(writer.next());
+        if (chunk == nullptr) break;
+        size_t size = encoder.encode(source(i, count, scratch.get()), count, chunk);
+        if (i + count == imageSize) {
+            writer.submit(size + encoder.finish(chunk + size));
+            break;
+        }
+        writer.submit(size);
+    }
+    return writer.finish();
+}
+bool encodeFile(OutputFile& file, ImageFormat type, ColorFormat cf, const Pixel* image, size_t imageSize) {
+    return encodeFile(file, type, cf, get_pixelSource(image), imageSize);
+}
+bool encodeFile(OutputFile& file, ImageFormat type, ColorFormat cf, const PixelSource& source, uint64_t imageSize) {
+    if (type == ImageFormat::qoi) return encodeQoi(file, source, imageSize);
+    ColorFormatEncoder encoder = get_encoder(cf);
+    size_t pixelSize = get_pixelSize(cf);
+    // Only whole pixels go into a chunk, .txt chunks are encoded into scratch first and expanded into the chunk
+    size_t bytesPerChunk = type == ImageFormat::txt ? chunkSize / 8 : chunkSize;
+    size_t pixelsPerChunk = bytesPerChunk / pixelSize;
+    std::unique_ptr<uint8_t[]> scratch(type == ImageFormat::txt ? new uint8_t[bytesPerChunk] : nullptr);
+    std::unique_ptr<Pixel[]> pixels(new Pixel[pixelsPerChunk]);
+    ChunkWriter writer(file);
+    for (uint64_t i = 0; i < imageSize; i += pixelsPerChunk) {
+        size_t count = static_cast<size_t>(std::min<uint64_t>(pixelsPerChunk, imageSize - i));
+        char* chunk = writer.next();
+        if (chunk == nullptr) break;
+        const Pixel* image = source(i, count, pixels.get());
+        if (type == ImageFormat::txt) {
+            // Every piece encodes and expands its own pixels
+            parallelFor(count, textGrain / pixelSize, [&](size_t begin, size_t end) {
+                uint8_t* bytes = scratch.get() + begin * pixelSize;
+                encoder(image + begin, bytes, end - begin);
+                writetxt(bytes, chunk + begin * pixelSize * 8, (end - begin) * pixelSize);
+            });
+            writer.submit(count * pixelSize * 8);
+        }
+        else {
+            encodeImage(image, count, cf, chunk);
+            writer.submit(count * pixelSize);
+        }
+    }
+    return writer.finish();
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "Codec.h"
+#include "FileStream.h"
+
+// Chunked file conversion for files too large to hold in memory.
+
+enum class StreamStatus {
+    ok,
+    readError,
+    invalidText,
+    truncated,      // a .qoi file ended before the image
+    cancelled,      // stopped by the progress callback
+};
+
+// Decodes a .bin, .txt or .qoi file like decodeImage, a few MB at a time whatever the file size.
+// A reader thread fills the next chunks while the current one is decoded. .txt files are checked
+// to the end even once the image is full, the invalid characters are reported in error. The header
+// of a .qoi file has to be read first, cf is ignored for it.
+StreamStatus decodeFile(InputFile& file, ImageFormat type, ColorFormat cf, Pixel* image, size_t imageSize, TextError& error);
+// decodeFile reporting the pixels decoded after every chunk to progress.
+StreamStatus decodeFile(InputFile& file, ImageFormat type, ColorFormat cf, Pixel* image, size_t imageSize, TextError& error,
+    const DecodeProgress& progress);
+// Encodes the image into a .bin, .ikt, .txt or .qoi file a few MB at a time, a writer thread writes the previous
+// chunks while the next one is encoded. An .ikt or .qoi header has to be written first, cf is ignored for .qoi.
+// Returns false if the file couldn't be written.
+bool encodeFile(OutputFile& file, ImageFormat type, ColorFormat cf, const Pixel* image, size_t imageSize);
+// encodeFile for images that aren't in memory as a whole, the pixels are taken from source a chunk at a time.
+bool encodeFile(OutputFile& file, ImageFormat type, ColorFormat cf, const PixelSource& source, uint64_t imageSize);
@@ -0,0 +1,143 @@
+#include "Pyramid.h"
+#include "Kernels.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <new>
+
+void halveRowScalar(const Pixel* top, const Pixel* bottom, Pixel* dst, size_t count) {
+    const uint8_t* upper = reinterpret_cast<const uint8_t*>(top);
+    const uint8_t* lower = reinterpret_cast<const uint8_t*>(bottom);
+    uint8_t* out = reinterpret_cast<uint8_t*>(dst);
+    for (size_t i = 0; i < count * 4; i++) {
+        size_t j = i / 4 * 8 + i % 4;
+        out[i] = static_cast<uint8_t>((upper[j] + upper[j + 4] + lower[j] + lower[j + 4] + 2) >> 2);
+    }
+}
+
+static RowHalver get_rowHalver() {
+    for (const KernelTable* table : get_simdKernels()) {
+        if (table != NULL && table->halveRow != NULL) return table->halveRow;
+    }
+    return halveRowScalar;
+}
+
+// Halves src into rows first to last of dst, whose size is src rounded up to even and halved. The last column and row
+// of odd sizes are averaged with themselves.
+static void halveImage(const PyramidLevel& src, Pixel* dst, size_t width, size_t first, size_t last) {
+    RowHalver halveRow = get_rowHalver();
+    parallelFor(last - first, 16, [&](size_t begin, size_t end) {
+        for (size_t y = first + begin; y < first + end; y++) {
+            const Pixel* top = src.pixels + 2 * y * src.width;
+            const Pixel* bottom = 2 * y + 1 < src.height ? top + src.width : top;
+            Pixel* out = dst + y * width;
+            halveRow(top, bottom, out, src.width / 2);
+            if (src.width % 2 != 0) {
+                Pixel last[2] = { top[src.width - 1], bottom[src.width - 1] };
+                Pixel pair[4] = { last[0], last[0], last[1], last[1] };
+                halveRowScalar(pair, pair + 2, out + width - 1, 1);
+            }
+        }
+    });
+}
+
+// The rows of the level under level made from its first rows.
+static size_t get_halvedRows(const PyramidLevel& level) {
+    return level.rows == level.height ? (level.height + 1) / 2 : level.rows / 2;
+}
+
+void ImagePyramid::build(const Pixel* image, size_t width, size_t height) {
+    build(image, width, height, height);
+}
+void ImagePyramid::build(const Pixel* image, size_t width, size_t height, size_t rows) {
+    clear();
+    PyramidLevel level;
+    level.pixels = image;
+    level.width = width;
+    level.height = height;
+    level.rows = rows;
+    levels.push_back(level);
+    addLevels();
+}
+void ImagePyramid::update(size_t rows) {
+    if (levels.empty() || rows <= levels[0].rows) return;
+    levels[0].rows = std::min(rows, levels[0].height);
+    // Only an image in memory is decoded bit by bit, its levels under the first one are the storage in order
+    for (size_t i = 1; i < levels.size(); i++) {
+        size_t halved = get_halvedRows(levels[i - 1]);
+        halveImage(levels[i - 1], storage[i - 1].get(), levels[i].width, levels[i].rows, halved);
+        levels[i].rows = halved;
+    }
+}
+void ImagePyramid::build(TileStore& store, size_t budget) {
+    clear();
+    PyramidLevel image;
+    image.store = &store;
+    image.width = static_cast<size_t>(store.width());
+    image.height = static_cast<size_t>(store.height());
+    image.rows = image.height;
+    levels.push_back(image);
+    // The largest level that fits in the budget together with the ones under it, about a third of its size
+    size_t shift = 0, width = image.width, height = image.height;
+    do {
+        shift++;
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+    } while ((width > 1 || height > 1) && width * height / 3 * 4 * sizeof(Pixel) > budget);
+    std::unique_ptr<Pixel[]> pixels(new (std::nothrow) Pixel[width * height]);
+    if (!pixels) return;
+    // Every row of the level is a band of 2^shift rows of the image halved shift times, ping-ponging between two buffers
+    size_t bandRows = size_t(1) << shift;
+    parallelFor(height, 1, [&](size_t begin, size_t end) {
+        std::unique_ptr<Pixel[]> buffers[2] = {
+            std::unique_ptr<Pixel[]>(new Pixel[bandRows * image.width]),
+            std::unique_ptr<Pixel[]>(new Pixel[bandRows / 2 * ((image.width + 1) / 2)]),
+        };
+        for (size_t y = begin; y < end; y++) {
+            PyramidLevel band;
+            band.pixels = buffers[0].get();
+            band.width = image.width;
+            band.height = band.rows = std::min(bandRows, image.height - y * bandRows);
+            store.copyPixels(static_cast<uint64_t>(y) * bandRows * image.width, band.width * band.height, buffers[0].get());
+            for (size_t i = 1; i <= shift; i++) {
+                size_t halfWidth = (band.width + 1) / 2, halfHeight = (band.height + 1) / 2;
+                Pixel* half = i == shift ? pixels.get() + y * width : buffers[i % 2].get();
+                halveImage(band, half, halfWidth, 0, halfHeight);
+                band.pixels = half;
+                band.width = halfWidth;
+                band.height = band.rows = halfHeight;
+            }
+        }
+    });
+    PyramidLevel level;
+    level.pixels = pixels.get();
+    level.width = width;
+    level.height = level.rows = height;
+    levels.push_back(level);
+    storage.push_back(std::move(pixels));
+    addLevels();
+}
+void ImagePyramid::addLevels() {
+    PyramidLevel level = levels.back();
+    while (level.width > 1 || level.height > 1) {
+        size_t halfWidth = (level.width + 1) / 2, halfHeight = (level.height + 1) / 2;
+        std::unique_ptr<Pixel[]> pixels(new (std::nothrow) Pixel[halfWidth * halfHeight]);
+        if (!pixels) break;
+        size_t halved = get_halvedRows(level);
+        halveImage(level, pixels.get(), halfWidth, 0, halved);
+        level.pixels = pixels.get();
+        level.width = halfWidth;
+        level.height = halfHeight;
+        level.rows = halved;
+        levels.push_back(level);
+        storage.push_back(std::move(pixels));
+    }
+}
+void ImagePyramid::clear() {
+    levels.clear();
+    storage.clear();
+}
+const PyramidLevel& ImagePyramid::levelFor(size_t width, size_t height) const {
+    size_t index = 0;
+    while (index + 1 < levels.size() && levels[index + 1].width >= width && levels[index + 1].height >= height) index++;
+    return levels[index];
+}
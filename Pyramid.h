@@ -0,0 +1,44 @@
+#pragma once
+
+#include "Codec.h"
+#include "TileStore.h"
+#include <memory>
+#include <vector>
+
+// One level of an ImagePyramid. Level 0 of an image left in its file has no pixels, it is read through store. While
+// the image is decoded only the first rows of a level are made from it, the ones under them mustn't be read.
+struct PyramidLevel {
+    const Pixel* pixels = NULL;
+    TileStore* store = NULL;
+    size_t width = 0, height = 0;
+    size_t rows = 0;
+};
+
+// Levels of an image that halve down to a single pixel, each one the previous one with a 2x2 box filter. Odd sizes round
+// up and repeat the last row or column. Drawing scales from the smallest level that is still as large as the display,
+// so fitting a huge image in the window reads a few MB instead of all of it.
+class ImagePyramid {
+public:
+    // Builds the levels under image on the thread pool. The image itself is level 0, it isn't copied and has to stay
+    // unchanged while the pyramid is used. Stops early without the memory for a level, the levels above still work.
+    void build(const Pixel* image, size_t width, size_t height);
+    // build for an image with only its first rows decoded yet, the levels are made as far as those go.
+    void build(const Pixel* image, size_t width, size_t height, size_t rows);
+    // Makes what the image rows decoded since build or the last update add to every level, the first rows are decoded now.
+    void update(size_t rows);
+    // Builds the levels under an image in store that fit in budget bytes. The first level kept is made in one pass
+    // over the file by halving bands of rows repeatedly, the levels between it and the image are left out.
+    void build(TileStore& store, size_t budget);
+    void clear();
+    size_t levelCount() const { return levels.size(); }
+    const PyramidLevel& level(size_t index) const { return levels[index]; }
+    // Returns the smallest level at least width x height, level 0 if even that is smaller.
+    const PyramidLevel& levelFor(size_t width, size_t height) const;
+
+private:
+    // Adds halved levels under the last one until a level has a single pixel.
+    void addLevels();
+
+    std::vector<PyramidLevel> levels;
+    std::vector<std::unique_ptr<Pixel[]>> storage;
+};
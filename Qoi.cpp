@@ -0,0 +1,162 @@
+#include "Qoi.h"
+#include <algorithm>
+#include <cstring>
+
+static const uint8_t qoiMagic[4] = { 'q', 'o', 'i', 'f' };
+static constexpr uint8_t opIndex = 0x00, opDiff = 0x40, opLuma = 0x80, opRun = 0xC0, opRgb = 0xFE, opRgba = 0xFF;
+static constexpr uint8_t opMask = 0xC0;
+
+static uint32_t loadBig32(const uint8_t* data) {
+    return static_cast<uint32_t>(data[0]) << 24 | data[1] << 16 | data[2] << 8 | data[3];
+}
+static void storeBig32(uint8_t* data, uint32_t value) {
+    for (int i = 0; i < 4; i++) data[i] = static_cast<uint8_t>(value >> (24 - 8 * i));
+}
+static int colorHash(uint8_t red, uint8_t green, uint8_t blue, uint8_t alpha) {
+    return (red * 3 + green * 5 + blue * 7 + alpha * 11) % 64;
+}
+static size_t opSize(uint8_t op) {
+    return op == opRgb ? 4 : op == opRgba ? 5 : (op & opMask) == opLuma ? 2 : 1;
+}
+
+HeaderStatus readQoiHeader(const uint8_t* data, uint64_t fileSize, QoiHeader& header) {
+    if (fileSize < qoiHeaderSize || memcmp(data, qoiMagic, sizeof(qoiMagic)) != 0) return HeaderStatus::invalid;
+    header.width = loadBig32(data + 4);
+    header.height = loadBig32(data + 8);
+    header.channels = data[12];
+    header.colorspace = data[13];
+    if (header.width == 0 || header.height == 0 || (header.channels != 3 && header.channels != 4) || header.colorspace > 1)
+        return HeaderStatus::invalid;
+    // Checked before anything is allocated for the image, every op takes at least a byte
+    uint64_t pixels = static_cast<uint64_t>(header.width) * header.height;
+    if (pixels > qoiMaxPixels) return HeaderStatus::invalid;
+    if (pixels > (fileSize - qoiHeaderSize) * qoiMaxRun) return HeaderStatus::truncated;
+    return HeaderStatus::ok;
+}
+void writeQoiHeader(const QoiHeader& header, uint8_t* data) {
+    memcpy(data, qoiMagic, sizeof(qoiMagic));
+    storeBig32(data + 4, header.width);
+    storeBig32(data + 8, header.height);
+    data[12] = header.channels;
+    data[13] = header.colorspace;
+}
+
+void QoiDecoder::push(const uint8_t* data, size_t size) {
+    if (carryCount != 0) {
+        size_t count = std::min(opSize(carry[0]) - carryCount, size);
+        memcpy(carry + carryCount, data, count);
+        carryCount += count;
+        data += count;
+        size -= count;
+        if (carryCount < opSize(carry[0])) return;
+        decodeOps(carry, carryCount);
+        carryCount = 0;
+    }
+    size_t used = decodeOps(data, size);
+    carryCount = size - used;
+    memcpy(carry, data + used, carryCount);
+}
+size_t QoiDecoder::decodeOps(const uint8_t* data, size_t size) {
+    // The state lives in locals while decoding, the members only keep it between pieces
+    uint8_t r = red, g = green, b = blue, a = alpha;
+    size_t i = 0, count = decoded;
+    while (i < size && count < imageSize) {
+        uint8_t op = data[i];
+        size_t length = opSize(op);
+        if (length > size - i) break;
+        size_t run = 1;
+        if (op >= opRgb) {
+            r = data[i + 1];
+            g = data[i + 2];
+            b = data[i + 3];
+            if (op == opRgba) a = data[i + 4];
+        }
+        else if ((op & opMask) == opIndex) {
+            r = cache[op][0];
+            g = cache[op][1];
+            b = cache[op][2];
+            a = cache[op][3];
+        }
+        else if ((op & opMask) == opDiff) {
+            r += ((op >> 4) & 3) - 2;
+            g += ((op >> 2) & 3) - 2;
+            b += (op & 3) - 2;
+        }
+        else if ((op & opMask) == opLuma) {
+            int greenDiff = (op & 0x3F) - 32;
+            r += greenDiff - 8 + (data[i + 1] >> 4);
+            g += greenDiff;
+            b += greenDiff - 8 + (data[i + 1] & 15);
+        }
+        else run = std::min<size_t>((op & 0x3F) + 1, imageSize - count);
+        i += length;
+        uint8_t* entry = cache[colorHash(r, g, b, a)];
+        entry[0] = r;
+        entry[1] = g;
+        entry[2] = b;
+        entry[3] = a;
+        Pixel pixel{ b, g, r, 0 };
+        if (run == 1) image[count++] = pixel;
+        else {
+            std::fill(image + count, image + count + run, pixel);
+            count += run;
+        }
+    }
+    red = r;
+    green = g;
+    blue = b;
+    alpha = a;
+    decoded = count;
+    // Whatever follows a full image is ignored, the end marker included
+    return decoded < imageSize ? i : size;
+}
+size_t QoiEncoder::encode(const Pixel* pixels, size_t count, uint8_t* data) {
+    uint8_t* out = data;
+    for (size_t i = 0; i < count; i++) {
+        // The viewer has no alpha, every pixel is opaque
+        Pixel pixel = pixels[i];
+        pixel.rgbReserved = 255;
+        if (memcmp(&pixel, &previous, sizeof(Pixel)) == 0) {
+            if (++run == qoiMaxRun) {
+                *out++ = static_cast<uint8_t>(opRun | (run - 1));
+                run = 0;
+            }
+            continue;
+        }
+        if (run != 0) {
+            *out++ = static_cast<uint8_t>(opRun | (run - 1));
+            run = 0;
+        }
+        int hash = colorHash(pixel.rgbRed, pixel.rgbGreen, pixel.rgbBlue, 255);
+        if (memcmp(&cache[hash], &pixel, sizeof(Pixel)) == 0) *out++ = static_cast<uint8_t>(opIndex | hash);
+        else {
+            cache[hash] = pixel;
+            int redDiff = static_cast<int8_t>(pixel.rgbRed - previous.rgbRed);
+            int greenDiff = static_cast<int8_t>(pixel.rgbGreen - previous.rgbGreen);
+            int blueDiff = static_cast<int8_t>(pixel.rgbBlue - previous.rgbBlue);
+            int redGreen = redDiff - greenDiff, blueGreen = blueDiff - greenDiff;
+            if (redDiff >= -2 && redDiff <= 1 && greenDiff >= -2 && greenDiff <= 1 && blueDiff >= -2 && blueDiff <= 1)
+                *out++ = static_cast<uint8_t>(opDiff | (redDiff + 2) << 4 | (greenDiff + 2) << 2 | (blueDiff + 2));
+            else if (greenDiff >= -32 && greenDiff <= 31 && redGreen >= -8 && redGreen <= 7 && blueGreen >= -8 && blueGreen <= 7) {
+                *out++ = static_cast<uint8_t>(opLuma | (greenDiff + 32));
+                *out++ = static_cast<uint8_t>((redGreen + 8) << 4 | (blueGreen + 8));
+            }
+            else {
+                *out++ = opRgb;
+                *out++ = pixel.rgbRed;
+                *out++ = pixel.rgbGreen;
+                *out++ = pixel.rgbBlue;
+            }
+        }
+        previous = pixel;
+    }
+    return out - data;
+}
+size_t QoiEncoder::finish(uint8_t* data) {
+    uint8_t* out = data;
+    if (run != 0) *out++ = static_cast<uint8_t>(opRun | (run - 1));
+    run = 0;
+    memset(out, 0, qoiEndSize - 1);
+    out[qoiEndSize - 1] = 1;
+    return out + qoiEndSize - data;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "Codec.h"
+#include "ImageHeader.h"
+
+// QOI, the "Quite OK Image" format from qoiformat.org: a 14 byte big endian header, then one op per pixel or run of
+// pixels against the previous pixel and a 64 entry cache of recent colors, then 7 zero bytes and a 1. Images are
+// written with 3 channels since the viewer has no alpha, the alpha of 4 channel files is dropped.
+struct QoiHeader {
+    uint32_t width = 0, height = 0;
+    uint8_t channels = 3;
+    uint8_t colorspace = 0;
+};
+static constexpr size_t qoiHeaderSize = 14;
+static constexpr size_t qoiEndSize = 8;
+// The reference decoder refuses larger images
+static constexpr uint64_t qoiMaxPixels = 400000000;
+// The most pixels one op covers, a run
+static constexpr uint64_t qoiMaxRun = 62;
+
+// data needs the first qoiHeaderSize bytes of the file if it has that many, fileSize is the size of the whole file.
+// Images larger than qoiMaxPixels are invalid, ones the file is too short to hold even in runs are truncated.
+HeaderStatus readQoiHeader(const uint8_t* data, uint64_t fileSize, QoiHeader& header);
+void writeQoiHeader(const QoiHeader& header, uint8_t* data);
+
+// Decodes ops arriving in pieces of any size, an op split between two pieces is carried over. Ops past the end of the
+// image are ignored.
+class QoiDecoder {
+public:
+    QoiDecoder(Pixel* image, size_t imageSize) : image(image), imageSize(imageSize) {}
+    void push(const uint8_t* data, size_t size);
+    bool full() const { return decoded == imageSize; }
+    size_t count() const { return decoded; }
+
+private:
+    // Decodes ops from data until one doesn't fit, returns the bytes used.
+    size_t decodeOps(const uint8_t* data, size_t size);
+
+    Pixel* image;
+    size_t imageSize;
+    size_t decoded = 0;
+    uint8_t red = 0, green = 0, blue = 0, alpha = 255;
+    uint8_t cache[64][4] = {};
+    // Large enough for the longest op, a full RGBA value
+    uint8_t carry[5];
+    size_t carryCount = 0;
+};
+
+// Encodes pixels given in pieces of any size, runs continue across pieces.
+class QoiEncoder {
+public:
+    // The most encode writes for count pixels.
+    static constexpr size_t maxSize(size_t count) { return count * 4 + 1; }
+    size_t encode(const Pixel* pixels, size_t count, uint8_t* data);
+    // Ends the last run and writes the end marker, at most 1 + qoiEndSize bytes.
+    size_t finish(uint8_t* data);
+
+private:
+    Pixel previous = { 0, 0, 0, 255 };
+    size_t run = 0;
+    Pixel cache[64] = {};
+};
@@ -0,0 +1,162 @@
+#include "Resample.h"
+#include "Kernels.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+// Every output coordinate takes taps source coordinates from its start on, with weights that sum to 1 << resampleBits.
+struct ResampleWeights {
+    size_t taps = 0;
+    std::vector<int32_t> starts;
+    std::vector<int16_t> weights;
+};
+
+static const double pi = 3.14159265358979323846;
+
+static double boxFilter(double x) {
+    return x > -0.5 && x <= 0.5 ? 1.0 : 0.0;
+}
+static double bilinearFilter(double x) {
+    x = fabs(x);
+    return x < 1.0 ? 1.0 - x : 0.0;
+}
+static double sinc(double x) {
+    if (x == 0.0) return 1.0;
+    x *= pi;
+    return sin(x) / x;
+}
+static double lanczosFilter(double x) {
+    return x > -3.0 && x < 3.0 ? sinc(x) * sinc(x / 3.0) : 0.0;
+}
+
+// Maps the centers of the output pixels from begin to end onto the source and samples the filter there, stretched by
+// the scale when downscaling.
+static ResampleWeights computeWeights(size_t srcSize, size_t dstSize, size_t begin, size_t end, ResampleFilter filter) {
+    double (*function)(double) = filter == ResampleFilter::box ? boxFilter : filter == ResampleFilter::bilinear ? bilinearFilter : lanczosFilter;
+    double support = filter == ResampleFilter::box ? 0.5 : filter == ResampleFilter::bilinear ? 1.0 : 3.0;
+    double scale = static_cast<double>(srcSize) / dstSize;
+    double filterScale = std::max(scale, 1.0);
+    support *= filterScale;
+    ResampleWeights result;
+    // Windows that would hang over the edges are moved inside, so every output pixel has the same number of taps
+    result.taps = std::min(static_cast<size_t>(ceil(support)) * 2 + 1, srcSize);
+    result.starts.resize(end - begin);
+    result.weights.resize((end - begin) * result.taps);
+    std::vector<double> weights(result.taps);
+    for (size_t i = begin; i < end; i++) {
+        double center = (i + 0.5) * scale;
+        size_t low = static_cast<size_t>(std::max(floor(center - support + 0.5), 0.0));
+        size_t high = std::min(static_cast<size_t>(floor(center + support + 0.5)), srcSize);
+        size_t start = std::min(low, srcSize - result.taps);
+        double total = 0.0;
+        std::fill(weights.begin(), weights.end(), 0.0);
+        for (size_t k = low; k < high; k++) {
+            weights[k - start] = function((k - center + 0.5) / filterScale);
+            total += weights[k - start];
+        }
+        int16_t* fixed = &result.weights[(i - begin) * result.taps];
+        if (total == 0.0) {
+            // Only for rounding at the very edge, the nearest pixel stands in
+            fixed[std::min(static_cast<size_t>(center), srcSize - 1) - start] = 1 << resampleBits;
+        }
+        else {
+            // Every weight is rounded with the error of the ones before it, so the sum comes out exact and flat areas
+            // stay flat. Long downscales spread the error over their many small taps instead of piling it on one.
+            double running = 0.0;
+            long previous = 0;
+            for (size_t k = 0; k < result.taps; k++) {
+                running += weights[k] / total * (1 << resampleBits);
+                long rounded = k + 1 == result.taps ? 1 << resampleBits : lround(running);
+                fixed[k] = static_cast<int16_t>(rounded - previous);
+                previous = rounded;
+            }
+        }
+        result.starts[i - begin] = static_cast<int32_t>(start);
+    }
+    return result;
+}
+
+static inline uint8_t clampChannel(int32_t value) {
+    return static_cast<uint8_t>(value < 0 ? 0 : value > 255 ? 255 : value);
+}
+void resampleRowScalar(const Pixel* src, Pixel* dst, size_t width, const int32_t* starts, const int16_t* weights, size_t taps) {
+    for (size_t x = 0; x < width; x++, weights += taps) {
+        const uint8_t* in = reinterpret_cast<const uint8_t*>(src + starts[x]);
+        int32_t sum[4] = { 1 << (resampleBits - 1), 1 << (resampleBits - 1), 1 << (resampleBits - 1), 1 << (resampleBits - 1) };
+        for (size_t k = 0; k < taps; k++, in += 4) {
+            for (int c = 0; c < 4; c++) sum[c] += in[c] * weights[k];
+        }
+        uint8_t* out = reinterpret_cast<uint8_t*>(dst + x);
+        for (int c = 0; c < 4; c++) out[c] = clampChannel(sum[c] >> resampleBits);
+    }
+}
+void resampleColumnsScalar(const Pixel* const* rows, const int16_t* weights, size_t taps, Pixel* dst, size_t begin, size_t end) {
+    for (size_t x = begin; x < end; x++) {
+        int32_t sum[4] = { 1 << (resampleBits - 1), 1 << (resampleBits - 1), 1 << (resampleBits - 1), 1 << (resampleBits - 1) };
+        for (size_t k = 0; k < taps; k++) {
+            const uint8_t* in = reinterpret_cast<const uint8_t*>(rows[k] + x);
+            for (int c = 0; c < 4; c++) sum[c] += in[c] * weights[k];
+        }
+        uint8_t* out = reinterpret_cast<uint8_t*>(dst + x);
+        for (int c = 0; c < 4; c++) out[c] = clampChannel(sum[c] >> resampleBits);
+    }
+}
+
+static RowResampler get_rowResampler() {
+    for (const KernelTable* table : get_simdKernels()) {
+        if (table != NULL && table->resampleRow != NULL) return table->resampleRow;
+    }
+    return resampleRowScalar;
+}
+static ColumnResampler get_columnResampler() {
+    for (const KernelTable* table : get_simdKernels()) {
+        if (table != NULL && table->resampleColumns != NULL) return table->resampleColumns;
+    }
+    return resampleColumnsScalar;
+}
+
+void resampleImage(const Pixel* src, size_t srcWidth, size_t srcHeight, Pixel* dst, size_t dstWidth, size_t dstHeight, ResampleFilter filter) {
+    resampleRegion(src, srcWidth, srcHeight, dstWidth, dstHeight, dst, 0, 0, dstWidth, dstHeight, filter);
+}
+void resampleRegion(const Pixel* src, size_t srcWidth, size_t srcHeight, size_t scaledWidth, size_t scaledHeight,
+    Pixel* dst, size_t left, size_t top, size_t width, size_t height, ResampleFilter filter) {
+    resampleWindow(src, srcWidth, 0, 0, srcWidth, srcHeight, scaledWidth, scaledHeight, dst, left, top, width, height, filter);
+}
+void get_resampleSpan(size_t srcSize, size_t scaledSize, size_t begin, size_t end, ResampleFilter filter, size_t& first, size_t& last) {
+    // The windows only move forward, so the first and the last one bound all of them
+    ResampleWeights weights = computeWeights(srcSize, scaledSize, begin, end, filter);
+    first = weights.starts.front();
+    last = weights.starts.back() + weights.taps;
+}
+void resampleWindow(const Pixel* window, size_t windowStride, size_t windowLeft, size_t windowTop, size_t srcWidth, size_t srcHeight,
+    size_t scaledWidth, size_t scaledHeight, Pixel* dst, size_t left, size_t top, size_t width, size_t height, ResampleFilter filter) {
+    ResampleWeights columns = computeWeights(srcWidth, scaledWidth, left, left + width, filter);
+    ResampleWeights rows = computeWeights(srcHeight, scaledHeight, top, top + height, filter);
+    for (int32_t& start : columns.starts) start -= static_cast<int32_t>(windowLeft);
+    RowResampler resampleRow = get_rowResampler();
+    ColumnResampler resampleColumns = get_columnResampler();
+    // Every band of output rows scales the source rows under it horizontally into its own buffer first, then
+    // vertically. Neighbouring bands scale the rows they share twice, so the bands aren't too thin.
+    parallelFor(height, 32, [&](size_t begin, size_t end) {
+        size_t first = rows.starts[begin], last = rows.starts[end - 1] + rows.taps;
+        std::unique_ptr<Pixel[]> band(new Pixel[(last - first) * width]);
+        for (size_t y = first; y < last; y++)
+            resampleRow(window + (y - windowTop) * windowStride, band.get() + (y - first) * width, width, columns.starts.data(), columns.weights.data(), columns.taps);
+        std::vector<const Pixel*> taps(rows.taps);
+        for (size_t y = begin; y < end; y++) {
+            for (size_t k = 0; k < rows.taps; k++) taps[k] = band.get() + (rows.starts[y] - first + k) * width;
+            resampleColumns(taps.data(), &rows.weights[y * rows.taps], rows.taps, dst + y * width, 0, width);
+        }
+    });
+}
+
+bool resampleFilterFromName(const char* name, ResampleFilter& filter) {
+    if (strcmp(name, "box") == 0) filter = ResampleFilter::box;
+    else if (strcmp(name, "bilinear") == 0) filter = ResampleFilter::bilinear;
+    else if (strcmp(name, "lanczos") == 0) filter = ResampleFilter::lanczos;
+    else return false;
+    return true;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "Codec.h"
+
+// Filters of resampleImage, from fastest to sharpest. Box averages the source pixels under every output pixel,
+// bilinear weighs them by distance, Lanczos uses three lobes of windowed sinc and rings a little at hard edges.
+enum class ResampleFilter { box, bilinear, lanczos };
+
+// Scales src to the size of dst on the thread pool. Both directions work, downscaling widens the filter so every
+// source pixel counts. rgbReserved is scaled like the other channels.
+void resampleImage(const Pixel* src, size_t srcWidth, size_t srcHeight, Pixel* dst, size_t dstWidth, size_t dstHeight, ResampleFilter filter);
+// Like resampleImage to scaledWidth x scaledHeight, but only computes the width x height pixels from left, top on,
+// which go to dst. Pieces of the scaled image come out the same as the whole of it.
+void resampleRegion(const Pixel* src, size_t srcWidth, size_t srcHeight, size_t scaledWidth, size_t scaledHeight,
+    Pixel* dst, size_t left, size_t top, size_t width, size_t height, ResampleFilter filter);
+// Returns the source pixels from first to last on one axis that the scaled ones from begin to end are made of.
+void get_resampleSpan(size_t srcSize, size_t scaledSize, size_t begin, size_t end, ResampleFilter filter, size_t& first, size_t& last);
+// resampleRegion from a part of the source, for sources that aren't in memory as a whole. window holds the source
+// pixels from windowLeft, windowTop on in rows windowStride pixels apart and covers the spans of the region.
+void resampleWindow(const Pixel* window, size_t windowStride, size_t windowLeft, size_t windowTop, size_t srcWidth, size_t srcHeight,
+    size_t scaledWidth, size_t scaledHeight, Pixel* dst, size_t left, size_t top, size_t width, size_t height, ResampleFilter filter);
+// Returns false if name isn't box, bilinear or lanczos.
+bool resampleFilterFromName(const char* name, ResampleFilter& filter);
@@ -0,0 +1,163 @@
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+struct Job {
+    const std::function<void(size_t, size_t)>* body;
+    size_t count, pieceSize, pieces;
+    std::atomic<size_t> next{ 0 };
+    // Workers still inside the job, guarded by the pool mutex
+    size_t users = 0;
+    // The first exception a piece threw, written once by whoever sets failed
+    std::atomic<bool> failed{ false };
+    std::exception_ptr error;
+
+    // Doesn't throw, a piece that throws skips the pieces nobody started yet.
+    void run() {
+        for (size_t piece; (piece = next++) < pieces; ) {
+            try {
+                (*body)(piece * pieceSize, std::min(count, (piece + 1) * pieceSize));
+            } catch (...) {
+                if (!failed.exchange(true)) error = std::current_exception();
+                next = pieces;
+            }
+        }
+    }
+};
+thread_local bool insideBody = false;
+
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threadCount) {
+        // Short of threads or memory, the pool makes do with the workers it got, the calling thread always takes part
+        try {
+            for (size_t i = 1; i < threadCount; i++)
+                workers.emplace_back(&ThreadPool::work, this);
+        }
+        catch (...) {
+        }
+    }
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        changed.notify_all();
+        for (std::thread& worker : workers) worker.join();
+    }
+    size_t size() const { return workers.size() + 1; }
+    // Returns false without running anything if another thread is using the pool.
+    bool run(Job& job) {
+        std::unique_lock<std::mutex> submit(submitting, std::try_to_lock);
+        if (!submit.owns_lock()) return false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            current = &job;
+            generation++;
+        }
+        changed.notify_all();
+        Finish finish(*this, job);
+        job.run();
+        return true;
+    }
+
+private:
+    // Takes the job off the pool once the calling thread is done with it, however it got there. No worker picks the
+    // job up after this, the ones still running it are waited for.
+    class Finish {
+    public:
+        Finish(ThreadPool& pool, Job& job) : pool(pool), job(job) { insideBody = true; }
+        ~Finish() {
+            insideBody = false;
+            std::unique_lock<std::mutex> lock(pool.mutex);
+            pool.current = nullptr;
+            pool.changed.wait(lock, [this] { return job.users == 0; });
+        }
+        Finish(const Finish&) = delete;
+        Finish& operator=(const Finish&) = delete;
+
+    private:
+        ThreadPool& pool;
+        Job& job;
+    };
+
+    void work() {
+        insideBody = true;
+        size_t seen = 0;
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            changed.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+            Job* job = current;
+            if (job == nullptr) continue;
+            job->users++;
+            lock.unlock();
+            job->run();
+            lock.lock();
+            if (--job->users == 0) changed.notify_all();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::mutex submitting;
+    std::mutex mutex;
+    std::condition_variable changed;
+    Job* current = nullptr;
+    size_t generation = 0;
+    bool stopping = false;
+};
+
+ThreadPool& get_pool() {
+    static ThreadPool pool(get_threadCount());
+    return pool;
+}
+}
+
+size_t get_threadCount() {
+    static const size_t count = [] {
+        long threads = 0;
+#ifdef _MSC_VER
+        // getenv is deprecated with SDL checks
+        char* value = nullptr;
+        size_t length;
+        if (_dupenv_s(&value, &length, "IKT_THREADS") == 0 && value != nullptr) {
+            threads = strtol(value, nullptr, 10);
+            free(value);
+        }
+#else
+        if (const char* value = getenv("IKT_THREADS")) threads = strtol(value, nullptr, 10);
+#endif
+        if (threads > 0) return static_cast<size_t>(threads);
+        return static_cast<size_t>(std::max(1u, std::thread::hardware_concurrency()));
+    }();
+    return count;
+}
+void parallelFor(size_t count, size_t grain, const std::function<void(size_t begin, size_t end)>& body) {
+    if (count == 0) return;
+    // A few pieces per thread even out pieces that take longer than others
+    size_t threads = get_threadCount();
+    size_t pieceSize = std::max(std::max<size_t>(grain, 1), (count + threads * 4 - 1) / (threads * 4));
+    if (threads == 1 || pieceSize >= count || insideBody) {
+        body(0, count);
+        return;
+    }
+    Job job;
+    job.body = &body;
+    job.count = count;
+    job.pieceSize = pieceSize;
+    job.pieces = (count + pieceSize - 1) / pieceSize;
+    if (!get_pool().run(job)) {
+        body(0, count);
+        return;
+    }
+    // Every piece has stopped, so error is no longer written
+    if (job.error) std::rethrow_exception(job.error);
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+// Shared worker pool with one thread per core, the IKT_THREADS environment variable overrides the count.
+size_t get_threadCount();
+// Runs body(begin, end) over pieces of [0, count) no smaller than grain, on the pool and the calling thread,
+// and returns once every piece is done. Runs serially when called from inside a body or while another
+// thread is using the pool. If a body throws, the pieces not started yet are skipped and the first exception
+// is rethrown once the others are done.
+void parallelFor(size_t count, size_t grain, const std::function<void(size_t begin, size_t end)>& body);
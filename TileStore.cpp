@@ -0,0 +1,72 @@
+#include "TileStore.h"
+#include <algorithm>
+#include <cstring>
+
+TileStore::TileStore(const uint8_t* data, size_t stride, ColorFormat cf, uint64_t width, uint64_t height, size_t budget)
+    : data(data), stride(stride), cf(cf), imageWidth(width), imageHeight(height), columns((width + tileSize - 1) / tileSize),
+    capacity(std::max<size_t>(budget / (tileSize * tileSize * sizeof(Pixel)), 1)) {
+}
+TileStore::TilePixels TileStore::get_tile(uint64_t column, uint64_t row) {
+    uint64_t key = row * columns + column;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = index.find(key);
+        if (found != index.end()) {
+            tiles.splice(tiles.begin(), tiles, found->second);
+            return found->second->pixels;
+        }
+    }
+    // Decoded without the lock, two threads needing the same tile at once both decode it and the second one keeps the first copy
+    size_t width = static_cast<size_t>(std::min<uint64_t>(tileSize, imageWidth - column * tileSize));
+    size_t height = static_cast<size_t>(std::min<uint64_t>(tileSize, imageHeight - row * tileSize));
+    std::shared_ptr<std::vector<Pixel>> pixels = std::make_shared<std::vector<Pixel>>(width * height);
+    const uint8_t* start = data + row * tileSize * stride + column * tileSize * get_pixelSize(cf);
+    decodeRows(reinterpret_cast<const char*>(start), stride, cf, pixels->data(), width, height);
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = index.find(key);
+    if (found != index.end()) return found->second->pixels;
+    tiles.push_front(Tile{ key, pixels });
+    index.emplace(key, tiles.begin());
+    while (tiles.size() > capacity) {
+        index.erase(tiles.back().key);
+        tiles.pop_back();
+    }
+    return pixels;
+}
+void TileStore::copyRegion(uint64_t left, uint64_t top, size_t width, size_t height, Pixel* dst, size_t dstStride) {
+    for (uint64_t row = top / tileSize; row * tileSize < top + height; row++) {
+        for (uint64_t column = left / tileSize; column * tileSize < left + width; column++) {
+            TilePixels tile = get_tile(column, row);
+            size_t tileWidth = static_cast<size_t>(std::min<uint64_t>(tileSize, imageWidth - column * tileSize));
+            // The part of the tile inside the region
+            uint64_t x0 = std::max(left, column * tileSize), x1 = std::min(left + width, column * tileSize + tileWidth);
+            uint64_t y0 = std::max(top, row * tileSize), y1 = std::min<uint64_t>(top + height, (row + 1) * tileSize);
+            for (uint64_t y = y0; y < y1; y++) {
+                memcpy(dst + (y - top) * dstStride + (x0 - left), tile->data() + (y - row * tileSize) * tileWidth + (x0 - column * tileSize),
+                    (x1 - x0) * sizeof(Pixel));
+            }
+        }
+    }
+}
+void TileStore::copyPixels(uint64_t first, size_t count, Pixel* dst) const {
+    size_t pixelSize = get_pixelSize(cf);
+    // Rows without padding between them are decoded in one go
+    if (stride == imageWidth * pixelSize) {
+        decodePixels(reinterpret_cast<const char*>(data + first * pixelSize), cf, dst, count);
+        return;
+    }
+    while (count != 0) {
+        uint64_t row = first / imageWidth, column = first % imageWidth;
+        size_t length = static_cast<size_t>(std::min<uint64_t>(count, imageWidth - column));
+        decodePixels(reinterpret_cast<const char*>(data + row * stride + column * pixelSize), cf, dst, length);
+        first += length;
+        count -= length;
+        dst += length;
+    }
+}
+PixelSource TileStore::get_source() const {
+    return [this](uint64_t first, size_t count, Pixel* scratch) {
+        copyPixels(first, count, scratch);
+        return static_cast<const Pixel*>(scratch);
+    };
+}
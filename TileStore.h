@@ -0,0 +1,48 @@
+#pragma once
+
+#include "Codec.h"
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// The pixels of an image too large to decode into memory, left in its mapped .bin or .ikt file and decoded in square
+// tiles when they are needed. The tiles used least recently are dropped once they take more than the memory budget.
+// Safe to use from several threads at once.
+class TileStore {
+public:
+    static constexpr size_t tileSize = 256;
+
+    // data holds height rows of width pixels in cf that start stride bytes apart, it has to stay mapped while the
+    // store is used.
+    TileStore(const uint8_t* data, size_t stride, ColorFormat cf, uint64_t width, uint64_t height, size_t budget);
+    uint64_t width() const { return imageWidth; }
+    uint64_t height() const { return imageHeight; }
+    // Copies the width x height pixels from left, top on into dst, in rows dstStride pixels apart.
+    void copyRegion(uint64_t left, uint64_t top, size_t width, size_t height, Pixel* dst, size_t dstStride);
+    // Copies count pixels in row order from first on. Meant for reading the whole image once, so they are decoded
+    // straight from the file and don't push the tiles of the view out.
+    void copyPixels(uint64_t first, size_t count, Pixel* dst) const;
+    // The store as a source for encodeFile and encodeCompressed.
+    PixelSource get_source() const;
+
+private:
+    typedef std::shared_ptr<const std::vector<Pixel>> TilePixels;
+    struct Tile {
+        uint64_t key;
+        TilePixels pixels;
+    };
+    TilePixels get_tile(uint64_t column, uint64_t row);
+
+    const uint8_t* data;
+    size_t stride;
+    ColorFormat cf;
+    uint64_t imageWidth, imageHeight;
+    uint64_t columns;
+    size_t capacity;
+    std::mutex mutex;
+    // Most recently used first, tiles still being copied from stay alive after they are dropped
+    std::list<Tile> tiles;
+    std::unordered_map<uint64_t, std::list<Tile>::iterator> index;
+};
@@ -0,0 +1,128 @@
+#include "Viewport.h"
+#include "Resample.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+
+uint64_t get_scaledSize(size_t size, double scale) {
+    return std::max<uint64_t>(llround(size * scale), 1);
+}
+View fitView(size_t width, size_t height, int64_t windowWidth, int64_t windowHeight) {
+    View view;
+    view.scale = std::min(static_cast<double>(windowWidth) / width, static_cast<double>(windowHeight) / height);
+    return clampView(view, width, height, windowWidth, windowHeight);
+}
+View zoomView(const View& view, double scale, int64_t x, int64_t y, size_t width, size_t height) {
+    View zoomed;
+    zoomed.scale = scale;
+    // The point is kept as a fraction of the image, the scaled sizes are rounded
+    double relativeX = (x + view.x + 0.5) / get_scaledSize(width, view.scale);
+    double relativeY = (y + view.y + 0.5) / get_scaledSize(height, view.scale);
+    zoomed.x = llround(relativeX * get_scaledSize(width, scale) - x - 0.5);
+    zoomed.y = llround(relativeY * get_scaledSize(height, scale) - y - 0.5);
+    return zoomed;
+}
+static int64_t clampOffset(int64_t offset, int64_t scaledSize, int64_t windowSize) {
+    if (scaledSize <= windowSize) return -((windowSize - scaledSize) / 2);
+    return std::min(std::max<int64_t>(offset, 0), scaledSize - windowSize);
+}
+View clampView(const View& view, size_t width, size_t height, int64_t windowWidth, int64_t windowHeight) {
+    View clamped = view;
+    clamped.x = clampOffset(view.x, get_scaledSize(width, view.scale), windowWidth);
+    clamped.y = clampOffset(view.y, get_scaledSize(height, view.scale), windowHeight);
+    return clamped;
+}
+
+size_t TileCache::KeyHash::operator()(const Key& key) const {
+    size_t hash = std::hash<double>()(key.scale);
+    hash = hash * 31 + std::hash<uint64_t>()(key.column);
+    return hash * 31 + std::hash<uint64_t>()(key.row);
+}
+TileCache::TileCache(const ImagePyramid& pyramid, size_t budget)
+    : pyramid(pyramid), capacity(std::max<size_t>(budget / (viewTileSize * viewTileSize * sizeof(Pixel)), 1)) {
+}
+void TileCache::clear() {
+    tiles.clear();
+    index.clear();
+}
+void TileCache::draw(const View& view, int64_t left, int64_t top, int64_t right, int64_t bottom, const std::function<void(const ViewTile&)>& draw) {
+    const PyramidLevel& image = pyramid.level(0);
+    int64_t scaledWidth = get_scaledSize(image.width, view.scale), scaledHeight = get_scaledSize(image.height, view.scale);
+    // The tiles overlapping the rectangle, in scaled image coordinates
+    int64_t firstColumn = std::max<int64_t>(left + view.x, 0) / viewTileSize;
+    int64_t firstRow = std::max<int64_t>(top + view.y, 0) / viewTileSize;
+    int64_t endColumn = (std::min(right + view.x, scaledWidth) + viewTileSize - 1) / static_cast<int64_t>(viewTileSize);
+    int64_t endRow = (std::min(bottom + view.y, scaledHeight) + viewTileSize - 1) / static_cast<int64_t>(viewTileSize);
+    std::vector<std::list<Tile>::iterator> visible, missing;
+    for (int64_t row = firstRow; row < endRow; row++) {
+        for (int64_t column = firstColumn; column < endColumn; column++) {
+            Key key{ view.scale, static_cast<uint64_t>(column), static_cast<uint64_t>(row) };
+            auto found = index.find(key);
+            if (found != index.end()) {
+                tiles.splice(tiles.begin(), tiles, found->second);
+                visible.push_back(found->second);
+                if (!found->second->complete) missing.push_back(found->second);
+                continue;
+            }
+            Tile tile;
+            tile.key = key;
+            tile.width = static_cast<size_t>(std::min<int64_t>(viewTileSize, scaledWidth - column * viewTileSize));
+            tile.height = static_cast<size_t>(std::min<int64_t>(viewTileSize, scaledHeight - row * viewTileSize));
+            tiles.push_front(std::move(tile));
+            index.emplace(key, tiles.begin());
+            visible.push_back(tiles.begin());
+            missing.push_back(tiles.begin());
+        }
+    }
+    // Zooming out scales from the first level at least as large as the view, at most twice as large, so bilinear
+    // filtering sees every pixel. Zooming in repeats pixels with the box filter so they can be told apart.
+    const PyramidLevel& level = pyramid.levelFor(scaledWidth, scaledHeight);
+    ResampleFilter filter = view.scale < 1.0 ? ResampleFilter::bilinear : ResampleFilter::box;
+    parallelFor(missing.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            Tile& tile = *missing[i];
+            tile.pixels.resize(tile.width * tile.height);
+            size_t left = static_cast<size_t>(tile.key.column * viewTileSize), top = static_cast<size_t>(tile.key.row * viewTileSize);
+            tile.complete = true;
+            if (level.pixels != NULL) {
+                // The rows that only need decoded rows of the level are scaled, the rest stays black for now
+                size_t rows = tile.height;
+                if (level.rows < level.height) {
+                    size_t low = 0, high = tile.height;
+                    while (low < high) {
+                        size_t middle = (low + high + 1) / 2, first, last;
+                        get_resampleSpan(level.height, scaledHeight, top, top + middle, filter, first, last);
+                        if (last <= level.rows) low = middle;
+                        else high = middle - 1;
+                    }
+                    rows = low;
+                    tile.complete = rows == tile.height;
+                    std::fill(tile.pixels.begin() + rows * tile.width, tile.pixels.end(), Pixel{ 0, 0, 0, 0 });
+                }
+                if (rows != 0) {
+                    resampleRegion(level.pixels, level.width, level.height, scaledWidth, scaledHeight, tile.pixels.data(),
+                        left, top, tile.width, rows, filter);
+                }
+                continue;
+            }
+            // An image left in its file is only read where the tile needs it
+            size_t firstColumn, endColumn, firstRow, endRow;
+            get_resampleSpan(level.width, scaledWidth, left, left + tile.width, filter, firstColumn, endColumn);
+            get_resampleSpan(level.height, scaledHeight, top, top + tile.height, filter, firstRow, endRow);
+            std::vector<Pixel> window((endColumn - firstColumn) * (endRow - firstRow));
+            level.store->copyRegion(firstColumn, firstRow, endColumn - firstColumn, endRow - firstRow, window.data(), endColumn - firstColumn);
+            resampleWindow(window.data(), endColumn - firstColumn, firstColumn, firstRow, level.width, level.height, scaledWidth, scaledHeight,
+                tile.pixels.data(), left, top, tile.width, tile.height, filter);
+        }
+    });
+    for (const auto& tile : visible) {
+        ViewTile piece{ tile->pixels.data(), tile->width, tile->height,
+            static_cast<int64_t>(tile->key.column * viewTileSize) - view.x, static_cast<int64_t>(tile->key.row * viewTileSize) - view.y };
+        draw(piece);
+    }
+    // Evicting last keeps the tiles just drawn even if the window needs more of them than the budget allows
+    while (tiles.size() > capacity) {
+        index.erase(tiles.back().key);
+        tiles.pop_back();
+    }
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "Pyramid.h"
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+// What the window shows: the image scaled by scale, rounded to whole pixels, with the top left corner of the window at
+// x, y of the scaled image. Negative offsets leave room to the left of or above the image.
+struct View {
+    double scale = 1.0;
+    int64_t x = 0, y = 0;
+};
+// Returns the size of size pixels at scale, at least 1.
+uint64_t get_scaledSize(size_t size, double scale);
+// Returns the view that fits the image in the window and centers it.
+View fitView(size_t width, size_t height, int64_t windowWidth, int64_t windowHeight);
+// Returns view at scale, with the point of the image under x, y of the window kept there.
+View zoomView(const View& view, double scale, int64_t x, int64_t y, size_t width, size_t height);
+// Centers the image on the axes it is smaller than the window on, and on the others moves it so the window is covered.
+View clampView(const View& view, size_t width, size_t height, int64_t windowWidth, int64_t windowHeight);
+
+// A piece of the view to draw at x, y of the window.
+struct ViewTile {
+    const Pixel* pixels;
+    size_t width, height;
+    int64_t x, y;
+};
+static constexpr size_t viewTileSize = 256;
+
+// The view is split into tiles of viewTileSize pixels at every scale it's shown at, which are scaled from the
+// smallest fitting level of the pyramid when they are first needed, through the TileStore if that is the image. Painting only draws tiles that are already scaled,
+// so panning scales just the tiles coming into the window. The ones used least recently are dropped when the tiles
+// take more than the memory budget.
+class TileCache {
+public:
+    TileCache(const ImagePyramid& pyramid, size_t budget);
+    // Drops every tile, for when the image changes.
+    void clear();
+    // Calls draw for every tile of view that overlaps the rectangle from left, top to right, bottom of the window,
+    // after scaling the ones that aren't cached on the thread pool. Needs the pyramid built, the rows of an image
+    // that isn't fully decoded yet are only read as far as its levels have them.
+    void draw(const View& view, int64_t left, int64_t top, int64_t right, int64_t bottom, const std::function<void(const ViewTile&)>& draw);
+
+private:
+    // The scale stands in for the zoom level, fitting the image in the window can need any of them
+    struct Key {
+        double scale;
+        uint64_t column, row;
+        bool operator==(const Key& other) const { return scale == other.scale && column == other.column && row == other.row; }
+    };
+    struct KeyHash {
+        size_t operator()(const Key& key) const;
+    };
+    struct Tile {
+        Key key;
+        size_t width, height;
+        std::vector<Pixel> pixels;
+        // Tiles reaching past the rows decoded so far are black there and scaled again whenever they are drawn
+        bool complete = false;
+    };
+
+    const ImagePyramid& pyramid;
+    size_t capacity;
+    // Most recently used first
+    std::list<Tile> tiles;
+    std::unordered_map<Key, std::list<Tile>::iterator, KeyHash> index;
+};